@@ -1,5 +1,6 @@
 #include "Affine.hpp"
 #include "Optimizer.hpp"
+#include "ParamRegistry.hpp"
 #include "Utils.hpp"
 #include "ActFunc.hpp"
 
@@ -82,6 +83,11 @@ void Affine::Grad::sgd(const Real learningRate, Affine& af){
   Optimizer::sgd(this->biasGrad, learningRate, af.bias);
 }
 
+void Affine::Grad::registerParams(const std::string& prefix, Affine& af, ParamRegistry& reg){
+  reg.add(prefix+"weight", af.weight, this->weightGrad);
+  reg.add(prefix+"bias", af.bias, this->biasGrad);
+}
+
 void Affine::Grad::adagrad(const Real learningRate, Affine& affine, const Real initVal){
   if (this->gradHist == 0){
     this->gradHist = new Affine::Grad(affine);
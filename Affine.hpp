@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Rand.hpp"
+#include <string>
+
+class ParamRegistry;
 
 class Affine{
 public:
@@ -53,6 +56,7 @@ public:
   void l2reg(const Real lambda, const Affine& af);
   void l2reg(const Real lambda, const Affine& af, const Affine& target);
   void sgd(const Real learningRate, Affine& af);
+  void registerParams(const std::string& prefix, Affine& af, ParamRegistry& reg);
   void adagrad(const Real learningRate, Affine& affine, const Real initVal = 1.0);
   void momentum(const Real learningRate, const Real m, Affine& affine);
   void operator += (const Affine::Grad& grad);
@@ -0,0 +1,6 @@
+#include "AllocTracker.hpp"
+
+thread_local unsigned long AllocTracker::count = 0;
+thread_local unsigned long AllocTracker::bytes = 0;
+std::atomic<unsigned long> AllocTracker::totalCount(0);
+std::atomic<unsigned long> AllocTracker::totalBytes(0);
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+//allocation counters, updated by the hooks below;
+//the hooks are installed only in the binaries defining N3LP_ALLOC_HOOKS before including this file (in one translation unit),
+//e.g., main.cpp with N3LP_ALLOC_TRACK (see Makefile) and bench.cpp
+class AllocTracker{
+public:
+  static thread_local unsigned long count; //per thread, for Profiler::Scope
+  static thread_local unsigned long bytes;
+  static std::atomic<unsigned long> totalCount;
+  static std::atomic<unsigned long> totalBytes;
+
+  static void add(const size_t size){
+    ++AllocTracker::count;
+    AllocTracker::bytes += size;
+    AllocTracker::totalCount.fetch_add(1, std::memory_order_relaxed);
+    AllocTracker::totalBytes.fetch_add(size, std::memory_order_relaxed);
+  };
+  static bool enabled(){
+    return AllocTracker::totalCount.load() > 0;
+  };
+};
+
+#ifdef N3LP_ALLOC_HOOKS
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t num, size_t size);
+  void* __libc_realloc(void* ptr, size_t size);
+  void __libc_free(void* ptr);
+}
+
+//Eigen allocates its matrices and vectors via std::malloc
+extern "C" void* malloc(size_t size) throw(){
+  AllocTracker::add(size);
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t num, size_t size) throw(){
+  AllocTracker::add(num*size);
+  return __libc_calloc(num, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) throw(){
+  AllocTracker::add(size);
+  return __libc_realloc(ptr, size);
+}
+
+//std::vector, std::string, std::unordered_map nodes, etc.; counted once (not again in malloc)
+void* operator new(size_t size){
+  void* ptr;
+
+  AllocTracker::add(size);
+
+  if ((ptr = __libc_malloc(size ? size : 1)) == 0){
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+void* operator new[](size_t size){
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw(){
+  AllocTracker::add(size);
+  return __libc_malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& nt) throw(){
+  return operator new(size, nt);
+}
+
+void operator delete(void* ptr) throw(){
+  __libc_free(ptr);
+}
+
+void operator delete[](void* ptr) throw(){
+  __libc_free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) throw(){
+  __libc_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) throw(){
+  __libc_free(ptr);
+}
+#endif
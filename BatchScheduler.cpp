@@ -0,0 +1,147 @@
+#include "BatchScheduler.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+struct sort_pred {
+  sort_pred(const std::vector<std::vector<int> >& input_):
+    input(input_)
+  {}
+
+  const std::vector<std::vector<int> >& input;
+
+  bool operator()(const int left, const int right) {
+    return this->input[left].size() > this->input[right].size();
+  }
+};
+}
+
+void BatchScheduler::schedule(const std::vector<std::vector<int> >& input, std::vector<BatchScheduler::Batch>& batches){
+  std::vector<int> order;
+  BatchScheduler::Batch batch;
+
+  for (int i = 0; i < (int)input.size(); ++i){
+    order.push_back(i);
+  }
+
+  //the longest batches come first so that they do not become stragglers
+  std::stable_sort(order.begin(), order.end(), sort_pred(input));
+  batches.clear();
+
+  for (auto it = order.begin(); it != order.end(); ++it){
+    const int length = input[*it].size();
+
+    if (!batch.id.empty() && batch.tokens+length > this->tokenBudget){
+      batches.push_back(batch);
+      batch = BatchScheduler::Batch();
+    }
+
+    batch.id.push_back(*it);
+    batch.tokens += length;
+  }
+
+  if (!batch.id.empty()){
+    batches.push_back(batch);
+  }
+}
+
+void BatchScheduler::push(const int id, const int length){
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    this->pending.push_back(BatchScheduler::Request(id, length));
+    this->pendingTokens += length;
+  }
+
+  this->cond.notify_one();
+}
+
+bool BatchScheduler::pop(BatchScheduler::Batch& batch){
+  std::unique_lock<std::mutex> lock(this->mtx);
+  const auto latency = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(this->maxLatency));
+
+  while (true){
+    if (this->pending.empty()){
+      if (this->closed){
+	return false;
+      }
+
+      this->cond.wait(lock);
+      continue;
+    }
+
+    if (this->closed || this->pendingTokens >= this->tokenBudget){
+      break;
+    }
+
+    if (this->maxLatency > 0.0){
+      const auto deadline = this->pending.front().arrival+latency;
+
+      if (std::chrono::steady_clock::now() >= deadline){
+	break;
+      }
+
+      this->cond.wait_until(lock, deadline);
+    }
+    else {
+      this->cond.wait(lock);
+    }
+  }
+
+  //the oldest request is always served, together with the requests of the closest lengths
+  const int anchor = this->pending.front().length;
+  std::vector<std::pair<int, int> > dist; //(distance in length, position in the queue)
+  std::vector<bool> taken(this->pending.size(), false);
+
+  for (int i = 1; i < (int)this->pending.size(); ++i){
+    dist.push_back(std::pair<int, int>(std::abs(this->pending[i].length-anchor), i));
+  }
+
+  std::sort(dist.begin(), dist.end());
+  batch = BatchScheduler::Batch();
+  batch.id.push_back(this->pending[0].id);
+  batch.tokens = anchor;
+  taken[0] = true;
+
+  for (auto it = dist.begin(); it != dist.end(); ++it){
+    const BatchScheduler::Request& req = this->pending[it->second];
+
+    if (batch.tokens+req.length > this->tokenBudget){
+      continue;
+    }
+
+    batch.id.push_back(req.id);
+    batch.tokens += req.length;
+    taken[it->second] = true;
+  }
+
+  std::deque<BatchScheduler::Request> rest;
+
+  for (int i = 0; i < (int)this->pending.size(); ++i){
+    if (!taken[i]){
+      rest.push_back(this->pending[i]);
+    }
+  }
+
+  const bool more = !rest.empty();
+
+  this->pending.swap(rest);
+  this->pendingTokens -= batch.tokens;
+  lock.unlock();
+
+  if (more){
+    this->cond.notify_one();
+  }
+
+  return true;
+}
+
+void BatchScheduler::close(){
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    this->closed = true;
+  }
+
+  this->cond.notify_all();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Matrix.hpp"
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+class BatchScheduler{
+public:
+  BatchScheduler(const int tokenBudget_, const Real maxLatency_ = -1.0):
+    tokenBudget(tokenBudget_), maxLatency(maxLatency_), pendingTokens(0), closed(false)
+  {};
+
+  class Request;
+  class Batch;
+
+  int tokenBudget; //max # of source tokens in a batch
+  Real maxLatency; //max waiting time (sec.) of a request in the online mode (<= 0: wait until the budget is filled)
+
+  //offline: sort all the requests by length and pack them
+  void schedule(const std::vector<std::vector<int> >& input, std::vector<BatchScheduler::Batch>& batches);
+
+  //online: requests arrive one by one and batches are taken by worker threads
+  std::deque<BatchScheduler::Request> pending;
+  int pendingTokens;
+  bool closed;
+  std::mutex mtx;
+  std::condition_variable cond;
+
+  void push(const int id, const int length);
+  bool pop(BatchScheduler::Batch& batch);
+  void close();
+};
+
+class BatchScheduler::Request{
+public:
+  Request(const int id_, const int length_):
+    id(id_), length(length_), arrival(std::chrono::steady_clock::now())
+  {};
+
+  int id;
+  int length;
+  std::chrono::steady_clock::time_point arrival;
+};
+
+class BatchScheduler::Batch{
+public:
+  Batch(): tokens(0) {};
+
+  std::vector<int> id;
+  int tokens;
+};
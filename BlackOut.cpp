@@ -1,5 +1,6 @@
 #include "BlackOut.hpp"
 #include "Utils.hpp"
+#include "Optimizer.hpp"
 #include <iostream>
 
 void BlackOut::initSampling(const VecD& freq, const Real alpha){
@@ -114,6 +115,18 @@ void BlackOut::sgd(const BlackOut::Grad& grad, const Real learningRate){
   }
 }
 
+void BlackOut::update(const BlackOut::Grad& grad, Optimizer& optimizer, const Real learningRate){
+  Optimizer::Moment& weightMom = optimizer.moment("blackout.weight", this->weight.rows(), this->weight.cols());
+  Optimizer::Moment& biasMom = optimizer.moment("blackout.bias", this->bias.rows(), 1);
+
+  for (auto it = grad.weight.begin(); it != grad.weight.end(); ++it){
+    optimizer.update(it->second, learningRate, weightMom, this->weight, it->first);
+  }
+  for (auto it = grad.bias.begin(); it != grad.bias.end(); ++it){
+    optimizer.update(it->second, learningRate, biasMom, this->bias, it->first);
+  }
+}
+
 void BlackOut::save(std::ofstream& ofs){
   Utils::save(ofs, this->weight);
   Utils::save(ofs, this->bias);
@@ -6,6 +6,8 @@
 #include <unordered_map>
 #include <fstream>
 
+class Optimizer;
+
 class BlackOut{
 public:
   BlackOut(){}
@@ -31,6 +33,7 @@ public:
   Real calcSampledLoss(const VecD& output);
   void backward(const VecD& input, const VecD& output, BlackOut::State& state, VecD& deltaFeature, BlackOut::Grad& grad);
   void sgd(const BlackOut::Grad& grad, const Real learningRate);
+  void update(const BlackOut::Grad& grad, Optimizer& optimizer, const Real learningRate); //lazy: only the sampled rows
   void save(std::ofstream& ofs);
   void load(std::ifstream& ifs);
 };
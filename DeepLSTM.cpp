@@ -1,4 +1,8 @@
 #include "DeepLSTM.hpp"
+#include "ParamRegistry.hpp"
+#include <atomic>
+#include <thread>
+#include <omp.h>
 
 DeepLSTM::DeepLSTM(const int inputDim, const int hiddenDim, const int depth){
   for (int i = 0; i < depth; ++i){
@@ -176,6 +180,162 @@ void DeepLSTM::backward(DeepLSTM::State* cur, DeepLSTM::Grad& grad, const VecD&
   }
 }
 
+//the wavefront needs a core per layer, and is not nested in the parallel regions of the callers (e.g., the threads of trainOpenMP)
+bool DeepLSTM::useWavefront() const {
+  const int depth = this->lstms.size();
+
+  return depth > 1 && omp_get_level() == 0 && omp_get_num_procs() >= depth;
+}
+
+void DeepLSTM::forwardSeq(const MatD& xs, std::vector<DeepLSTM::State*>& state){
+  if (this->useWavefront()){
+    this->forwardWavefront(xs, state);
+  }
+  else {
+    this->forwardLayers(xs, state);
+  }
+}
+
+void DeepLSTM::backwardSeq(const MatD& xs, std::vector<DeepLSTM::State*>& state, DeepLSTM::Grad& grad){
+  if (!this->useWavefront()){
+    this->backwardLayers(xs, state, grad);
+    return;
+  }
+
+  //the steps of the wavefront add to delc of the previous states, which backwardLayers resets by itself
+  for (int t = 0; t < xs.cols(); ++t){
+    for (auto it = state[t]->lstm.begin(); it != state[t]->lstm.end(); ++it){
+      (*it)->delc.setZero((*it)->c.rows());
+    }
+  }
+
+  this->backwardWavefront(xs, state, grad);
+}
+
+void DeepLSTM::forwardLayers(const MatD& xs, std::vector<DeepLSTM::State*>& state){
+  std::vector<LSTM::State*> layer(xs.cols()+1);
+  MatD hs;
+
+  for (int i = 0; i < (int)this->lstms.size(); ++i){
+    for (int t = 0; t <= xs.cols(); ++t){
+      layer[t] = state[t]->lstm[i];
+    }
+
+    if (i == 0){
+      this->lstms[0].forwardSeq(xs, layer);
+    }
+    else {
+      this->lstms[i].forwardSeq(hs, layer);
+    }
+
+    if (i+1 < (int)this->lstms.size()){
+      hs.resize(layer[1]->h.rows(), xs.cols());
+
+      for (int t = 0; t < xs.cols(); ++t){
+	hs.col(t) = layer[t+1]->h;
+      }
+    }
+  }
+}
+
+void DeepLSTM::backwardLayers(const MatD& xs, std::vector<DeepLSTM::State*>& state, DeepLSTM::Grad& grad){
+  std::vector<LSTM::State*> layer(xs.cols()+1);
+  MatD hs;
+
+  for (int i = this->lstms.size()-1; i >= 0; --i){
+    for (int t = 0; t <= xs.cols(); ++t){
+      layer[t] = state[t]->lstm[i];
+    }
+
+    if (i == 0){
+      this->lstms[0].backwardSeq(xs, layer, grad.lstm[0]);
+      continue;
+    }
+
+    hs.resize(state[0]->lstm[i-1]->h.rows(), xs.cols());
+
+    for (int t = 0; t < xs.cols(); ++t){
+      hs.col(t) = state[t+1]->lstm[i-1]->h;
+    }
+
+    this->lstms[i].backwardSeq(hs, layer, grad.lstm[i]);
+
+    for (int t = 1; t <= xs.cols(); ++t){
+      state[t]->lstm[i-1]->delh += state[t]->lstm[i]->delx;
+    }
+  }
+}
+
+//the i-th layer at time t only depends on the (i-1)-th layer at t and the i-th layer at t-1,
+//so each layer is run by its own thread and h is handed over through the per-layer progress counters
+void DeepLSTM::forwardWavefront(const MatD& xs, std::vector<DeepLSTM::State*>& state){
+  const int depth = this->lstms.size();
+  const int T = xs.cols();
+  std::vector<std::atomic<int> > done(depth); //# of the time steps finished by each layer
+
+  for (int i = 0; i < depth; ++i){
+    done[i].store(0);
+  }
+
+#pragma omp parallel num_threads(depth) proc_bind(close) shared(done, state)
+  {
+    //with fewer threads than layers (e.g., in a nested region), a thread takes several layers from the bottom
+    for (int i = omp_get_thread_num(); i < depth; i += omp_get_num_threads()){
+      for (int t = 1; t <= T; ++t){
+	if (i == 0){
+	  this->lstms[0].forward(xs.col(t-1), state[t-1]->lstm[0], state[t]->lstm[0]);
+	}
+	else {
+	  while (done[i-1].load(std::memory_order_acquire) < t){
+	    std::this_thread::yield();
+	  }
+
+	  this->lstms[i].forward(state[t]->lstm[i-1]->h, state[t-1]->lstm[i], state[t]->lstm[i]);
+	}
+
+	done[i].store(t, std::memory_order_release);
+      }
+    }
+  }
+}
+
+//delh and delc of all the states should be initialized (by zeros or by the gradients from the upper modules)
+void DeepLSTM::backwardWavefront(const MatD& xs, std::vector<DeepLSTM::State*>& state, DeepLSTM::Grad& grad){
+  const int depth = this->lstms.size();
+  const int T = xs.cols();
+  std::vector<std::atomic<int> > done(depth); //# of the time steps finished by each layer
+
+  for (int i = 0; i < depth; ++i){
+    done[i].store(0);
+  }
+
+#pragma omp parallel num_threads(depth) proc_bind(close) shared(done, state, grad)
+  {
+    //the top layer goes first
+    for (int i = depth-1-omp_get_thread_num(); i >= 0; i -= omp_get_num_threads()){
+      for (int t = T; t >= 1; --t){
+	if (i < depth-1){
+	  while (done[i+1].load(std::memory_order_acquire) < T-t+1){
+	    std::this_thread::yield();
+	  }
+
+	  //added by the lower layer itself, which is the only writer of its deltas
+	  state[t]->lstm[i]->delh += state[t]->lstm[i+1]->delx;
+	}
+
+	if (i == 0){
+	  this->lstms[0].backward(state[t-1]->lstm[0], state[t]->lstm[0], grad.lstm[0], xs.col(t-1));
+	}
+	else {
+	  this->lstms[i].backward(state[t-1]->lstm[i], state[t]->lstm[i], grad.lstm[i], state[t]->lstm[i-1]->h);
+	}
+
+	done[i].store(T-t+1, std::memory_order_release);
+      }
+    }
+  }
+}
+
 void DeepLSTM::sgd(const DeepLSTM::Grad& grad, const Real learningRate){
   for (int i = 0; i < (int)grad.lstm.size(); ++i){
     this->lstms[i].sgd(grad.lstm[i], learningRate);
@@ -194,6 +354,129 @@ void DeepLSTM::load(std::ifstream& ifs){
   }
 }
 
+RNN::State* DeepLSTM::newState() const {
+  return new DeepLSTM::State(*this);
+}
+
+RNN::Grad* DeepLSTM::newGrad() const {
+  return new DeepLSTM::Grad(*this);
+}
+
+int DeepLSTM::stateDim() const {
+  return 2*this->lstms.size()*this->lstms[0].bi.rows();
+}
+
+void DeepLSTM::getState(const RNN::State* s, VecD& v) const {
+  const DeepLSTM::State* state = (const DeepLSTM::State*)s;
+  const int H = this->lstms[0].bi.rows();
+
+  v.resize(this->stateDim());
+
+  for (int i = 0; i < (int)this->lstms.size(); ++i){
+    v.segment(2*i*H, H) = state->lstm[i]->h;
+    v.segment((2*i+1)*H, H) = state->lstm[i]->c;
+  }
+}
+
+void DeepLSTM::setState(const VecD& v, RNN::State* s) const {
+  DeepLSTM::State* state = (DeepLSTM::State*)s;
+  const int H = this->lstms[0].bi.rows();
+
+  for (int i = 0; i < (int)this->lstms.size(); ++i){
+    state->lstm[i]->h = v.segment(2*i*H, H);
+    state->lstm[i]->c = v.segment((2*i+1)*H, H);
+  }
+
+  state->h = state->lstm.back()->h;
+}
+
+void DeepLSTM::getStateGrad(const RNN::State* s, VecD& v) const {
+  const DeepLSTM::State* state = (const DeepLSTM::State*)s;
+  const int H = this->lstms[0].bi.rows();
+
+  v.resize(this->stateDim());
+
+  for (int i = 0; i < (int)this->lstms.size(); ++i){
+    v.segment(2*i*H, H) = state->lstm[i]->delh;
+    v.segment((2*i+1)*H, H) = state->lstm[i]->delc;
+  }
+}
+
+//h of the top layer is the output, so its part is added to state->delh (as LSTM::setStateGrad), which backwardSeq passes to the top layer;
+//h of the lower layers and c are not the output, and are set
+void DeepLSTM::setStateGrad(const VecD& v, RNN::State* s) const {
+  DeepLSTM::State* state = (DeepLSTM::State*)s;
+  const int H = this->lstms[0].bi.rows();
+  const int top = this->lstms.size()-1;
+
+  for (int i = 0; i < top; ++i){
+    state->lstm[i]->delh = v.segment(2*i*H, H);
+    state->lstm[i]->delc = v.segment((2*i+1)*H, H);
+  }
+
+  state->delh += v.segment(2*top*H, H);
+  state->lstm[top]->delh.setZero(H);
+  state->lstm[top]->delc = v.segment((2*top+1)*H, H);
+}
+
+void DeepLSTM::forward(const VecD& xt, const RNN::State* prev, RNN::State* cur){
+  DeepLSTM::State* state = (DeepLSTM::State*)cur;
+
+  this->forward(xt, (const DeepLSTM::State*)prev, state);
+  state->h = state->lstm.back()->h;
+}
+
+void DeepLSTM::forwardSeq(const MatD& xs, std::vector<RNN::State*>& state){
+  std::vector<DeepLSTM::State*> seq(xs.cols()+1);
+
+  for (int t = 0; t <= xs.cols(); ++t){
+    seq[t] = (DeepLSTM::State*)state[t];
+  }
+
+  this->forwardSeq(xs, seq);
+
+  for (int t = 1; t <= xs.cols(); ++t){
+    seq[t]->h = seq[t]->lstm.back()->h;
+  }
+}
+
+void DeepLSTM::backwardSeq(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad){
+  const int T = xs.cols();
+  const VecD zeros = VecD::Zero(this->lstms[0].bi.rows());
+  std::vector<DeepLSTM::State*> seq(T+1);
+
+  for (int t = 0; t <= T; ++t){
+    seq[t] = (DeepLSTM::State*)state[t];
+
+    //the last state already has the gradient w.r.t. the recurrent state (by setStateGrad)
+    if (t < T){
+      for (auto it = seq[t]->lstm.begin(); it != seq[t]->lstm.end(); ++it){
+	(*it)->delh = zeros;
+      }
+    }
+
+    seq[t]->lstm.back()->delh += seq[t]->delh;
+  }
+
+  this->backwardSeq(xs, seq, (DeepLSTM::Grad&)grad);
+
+  for (int t = 1; t <= T; ++t){
+    seq[t]->delx = seq[t]->lstm[0]->delx;
+  }
+}
+
+void DeepLSTM::sgd(const RNN::Grad& grad, const Real learningRate){
+  this->sgd((const DeepLSTM::Grad&)grad, learningRate);
+}
+
+void DeepLSTM::registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg){
+  DeepLSTM::Grad& g = (DeepLSTM::Grad&)grad;
+
+  for (int i = 0; i < (int)g.lstm.size(); ++i){
+    this->lstms[i].registerParams(g.lstm[i], prefix+"l"+std::to_string(i)+".", reg);
+  }
+}
+
 void DeepLSTM::operator += (const DeepLSTM& lstm){
   for (unsigned int i = 0; i < this->lstms.size(); ++i){
     this->lstms[i] += lstm.lstms[i];
@@ -216,6 +499,20 @@ void DeepLSTM::State::clear(){
   for (auto it = this->lstm.begin(); it != this->lstm.end(); ++it){
     (*it)->clear();
   }
+
+  this->h = VecD();
+  this->delh = VecD();
+  this->delx = VecD();
+}
+
+unsigned long DeepLSTM::State::bytes(){
+  unsigned long res = sizeof(Real)*(this->h.size()+this->delh.size()+this->delx.size());
+
+  for (auto it = this->lstm.begin(); it != this->lstm.end(); ++it){
+    res += (*it)->bytes();
+  }
+
+  return res;
 }
 
 DeepLSTM::Grad::Grad(const DeepLSTM& dlstm){
@@ -224,6 +521,10 @@ DeepLSTM::Grad::Grad(const DeepLSTM& dlstm){
   }
 }
 
+void DeepLSTM::Grad::init(){
+  this->init(this->lstm.size()-1);
+}
+
 void DeepLSTM::Grad::init(int depth){
   if (depth == -1){
     depth = this->lstm.size()-1;
@@ -234,6 +535,10 @@ void DeepLSTM::Grad::init(int depth){
   }
 }
 
+Real DeepLSTM::Grad::norm(){
+  return this->norm(this->lstm.size()-1);
+}
+
 Real DeepLSTM::Grad::norm(int depth){
   Real res = 0.0;
 
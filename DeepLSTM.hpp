@@ -2,7 +2,7 @@
 
 #include "LSTM.hpp"
 
-class DeepLSTM{
+class DeepLSTM : public RNN{
 public:
   DeepLSTM(){};
   DeepLSTM(const int inputDim, const int hiddenDim, const int depth);
@@ -22,16 +22,44 @@ public:
   void save(std::ofstream& ofs);
   void load(std::ifstream& ifs);
 
+  //over a whole sequence, by the wavefront if useWavefront() and layer by layer otherwise;
+  //delh of all the states and delc of the last states should be initialized (the lower layers receive delx of the upper ones)
+  bool useWavefront() const;
+  void forwardSeq(const MatD& xs, std::vector<DeepLSTM::State*>& state);
+  void backwardSeq(const MatD& xs, std::vector<DeepLSTM::State*>& state, DeepLSTM::Grad& grad);
+
+  //layer by layer over a whole sequence, with the input projections of each layer computed at once
+  void forwardLayers(const MatD& xs, std::vector<DeepLSTM::State*>& state);
+  void backwardLayers(const MatD& xs, std::vector<DeepLSTM::State*>& state, DeepLSTM::Grad& grad);
+
+  //wavefront over a whole sequence: state[0] is the initial state and state[t+1] corresponds to xs.col(t)
+  void forwardWavefront(const MatD& xs, std::vector<DeepLSTM::State*>& state);
+  void backwardWavefront(const MatD& xs, std::vector<DeepLSTM::State*>& state, DeepLSTM::Grad& grad);
+
   void forward(const VecD& xt, const VecD& at, const DeepLSTM::State* prev, DeepLSTM::State* cur, int startDepth  = -1, int endDepth = -1);
   void forward(const VecD& xt, const VecD& at, DeepLSTM::State* cur, int startDepth  = -1, int endDepth = -1);
   void backward(DeepLSTM::State* prev, DeepLSTM::State* cur, DeepLSTM::Grad& grad, const VecD& xt, const VecD& at, int startDepth  = -1, int endDepth = -1);
   void backward(DeepLSTM::State* cur, DeepLSTM::Grad& grad, const VecD& xt, const VecD& at, int startDepth  = -1, int endDepth = -1);
 
+  //RNN interface (the recurrent state is [h; c] of all the layers, and the output is h of the top layer)
+  RNN::State* newState() const;
+  RNN::Grad* newGrad() const;
+  int stateDim() const;
+  void getState(const RNN::State* s, VecD& v) const;
+  void setState(const VecD& v, RNN::State* s) const;
+  void getStateGrad(const RNN::State* s, VecD& v) const;
+  void setStateGrad(const VecD& v, RNN::State* s) const;
+  void forward(const VecD& xt, const RNN::State* prev, RNN::State* cur);
+  void forwardSeq(const MatD& xs, std::vector<RNN::State*>& state);
+  void backwardSeq(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad);
+  void sgd(const RNN::Grad& grad, const Real learningRate);
+  void registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg);
+
   void operator += (const DeepLSTM& lstm);
   void operator /= (const Real val);
 };
 
-class DeepLSTM::State{
+class DeepLSTM::State: public RNN::State{
 public:
   ~State() {this->clear();}
   State(const DeepLSTM& dlstm);
@@ -39,17 +67,20 @@ public:
   std::vector<LSTM::State*> lstm;
 
   void clear();
+  unsigned long bytes();
 };
 
-class DeepLSTM::Grad{
+class DeepLSTM::Grad: public RNN::Grad{
 public:
   Grad(){}
   Grad(const DeepLSTM& dlstm);
 
   std::vector<LSTM::Grad> lstm;
 
-  void init(int depth = -1);
-  Real norm(int depth = -1);
+  void init();
+  void init(int depth);
+  Real norm();
+  Real norm(int depth);
   void sgd(const Real learningRate, const unsigned int depth, DeepLSTM& lstm);
   void adagrad(const Real learningRate, DeepLSTM& lstm, const Real initVal = 1.0);
   void momentum(const Real learningRate, const Real m, DeepLSTM& lstm);
@@ -1,29 +1,50 @@
 #include "EncDec.hpp"
+#include "LSTM.hpp"
+#include "LnLSTM.hpp"
+#include "GRU.hpp"
+#include "DeepLSTM.hpp"
+#include "QuantLSTM.hpp"
 #include "Utils.hpp"
+#include "ActFunc.hpp"
+#include "Profiler.hpp"
+#include "Numa.hpp"
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <sys/time.h>
 #include <omp.h>
 
-EncDec::EncDec(Vocabulary& sourceVoc_, Vocabulary& targetVoc_, std::vector<EncDec::Data*>& trainData_, std::vector<EncDec::Data*>& devData_, const int inputDim, const int hiddenDim, const bool useBlackout_):
-  useBlackout(useBlackout_), sourceVoc(sourceVoc_), targetVoc(targetVoc_), trainData(trainData_), devData(devData_)
+EncDec::EncDec(Vocabulary& sourceVoc_, Vocabulary& targetVoc_, std::vector<EncDec::Data*>& trainData_, std::vector<EncDec::Data*>& devData_, const int inputDim, const int hiddenDim, const bool useBlackout_, const bool bidirectional_, const bool useAttention_, const EncDec::CELL cell_, const int depth):
+  useBlackout(useBlackout_), bidirectional(bidirectional_), useAttention(useAttention_), cell(cell_), sourceVoc(sourceVoc_), targetVoc(targetVoc_), trainData(trainData_), devData(devData_),
+  encRev(0), lengthPenalty(0.0), pruneRelative(-1.0), pruneAbsolute(-1.0), checkpoint(0), encCache(0),
+  asynchronous(false), maxStaleness(-1), ring(0), pinThreads(false), quantized(false), halved(false)
 {
   const Real scale = 0.1;
 
-  this->enc = LSTM(inputDim, hiddenDim);
-  this->enc.init(this->rnd, scale);
-  this->dec = LSTM(inputDim, hiddenDim);
-  this->dec.init(this->rnd, scale);
+  this->enc = this->newRNN(inputDim, hiddenDim, depth);
+
+  if (this->bidirectional){
+    this->encRev = this->newRNN(inputDim, hiddenDim, depth);
+  }
+
+  this->dec = this->newRNN(inputDim, hiddenDim, depth);
+
+  if (this->useAttention){
+    this->attn = Affine(2*hiddenDim, hiddenDim);
+    this->attn.act = Affine::TANH;
+    this->attn.init(this->rnd, scale);
+  }
+
   this->sourceEmbed = MatD(inputDim, this->sourceVoc.tokenList.size());
   this->targetEmbed = MatD(inputDim, this->targetVoc.tokenList.size());
   this->rnd.uniform(this->sourceEmbed, scale);
   this->rnd.uniform(this->targetEmbed, scale);
   this->zeros = VecD::Zero(hiddenDim);
 
-  //Bias 1
-  this->enc.bf.fill(1.0);
-  this->dec.bf.fill(1.0);
-
   if (!this->useBlackout){
     this->softmax = SoftMax(hiddenDim, this->targetVoc.tokenList.size());
   }
@@ -41,28 +62,264 @@ EncDec::EncDec(Vocabulary& sourceVoc_, Vocabulary& targetVoc_, std::vector<EncDe
   }
 
   for (int j = 0; j < (int)this->devData.size(); ++j){
-    this->encStateDev.push_back(std::vector<LSTM::State*>());
-    this->decStateDev.push_back(std::vector<LSTM::State*>());
+    this->encStateDev.push_back(std::vector<RNN::State*>());
+    this->decStateDev.push_back(std::vector<RNN::State*>());
     
-    for (int i = 0; i < 200; ++i){
-      this->encStateDev.back().push_back(new LSTM::State);
-      this->decStateDev.back().push_back(new LSTM::State);
+    for (int i = 0; i < this->encStateNum(this->devData[j]->src.size()); ++i){
+      this->encStateDev.back().push_back(this->enc->newState());
+    }
+    for (int i = 0; i < (int)this->devData[j]->tgt.size(); ++i){
+      this->decStateDev.back().push_back(this->dec->newState());
+    }
+  }
+}
+
+EncDec::~EncDec(){
+  delete this->enc;
+  delete this->encRev;
+  delete this->dec;
+  delete this->ring;
+  delete this->encCache;
+
+  for (auto it = this->replica.begin(); it != this->replica.end(); ++it){
+    if (*it != this){
+      delete *it;
+    }
+  }
+}
+
+//the initialized unit of the selected type, with the forget gate bias 1 for the LSTMs
+RNN* EncDec::newRNN(const int inputDim, const int hiddenDim, const int depth){
+  const Real scale = 0.1;
+
+  if (this->cell == EncDec::LNLSTM_CELL){
+    LnLSTM* lnlstm = new LnLSTM(inputDim, hiddenDim);
+
+    lnlstm->init(this->rnd, scale);
+    lnlstm->bf.fill(1.0);
+    return lnlstm;
+  }
+  else if (this->cell == EncDec::GRU_CELL){
+    GRU* gru = new GRU(inputDim, hiddenDim);
+
+    gru->init(this->rnd, scale);
+    return gru;
+  }
+  else if (this->cell == EncDec::DEEPLSTM_CELL){
+    DeepLSTM* dlstm = new DeepLSTM(inputDim, hiddenDim, depth);
+
+    dlstm->init(this->rnd, scale);
+
+    for (auto it = dlstm->lstms.begin(); it != dlstm->lstms.end(); ++it){
+      it->bf.fill(1.0);
+    }
+
+    return dlstm;
+  }
+
+  LSTM* lstm = new LSTM(inputDim, hiddenDim);
+
+  lstm->init(this->rnd, scale);
+  lstm->bf.fill(1.0);
+  return lstm;
+}
+
+int EncDec::encStateNum(const int srcLen){
+  return (this->bidirectional ? 2 : 1)*(srcLen+1);
+}
+
+void EncDec::encode(const std::vector<int>& src, std::vector<RNN::State*>& encState){
+  const int T = src.size();
+  const VecD init = VecD::Zero(this->enc->stateDim());
+  MatD xs;
+
+  this->enc->setState(init, encState[0]);
+  this->lookup(true, src, T, xs);
+
+  if (!this->bidirectional){
+    this->enc->forwardSeq(xs, encState);
+    return;
+  }
+
+  std::vector<RNN::State*> encStateRev(encState.begin()+T+1, encState.begin()+2*T+2);
+
+  this->encRev->setState(init, encStateRev[0]);
+
+  //the two directions are independent of each other
+#pragma omp parallel sections num_threads(2)
+  {
+#pragma omp section
+    this->enc->forwardSeq(xs, encState);
+#pragma omp section
+    this->encRev->forwardSeq(xs.rowwise().reverse(), encStateRev);
+  }
+}
+
+//for training: the encoder memory is taken during the forward pass, as the activations between the checkpoints are dropped
+void EncDec::encode(const std::vector<int>& src, std::vector<RNN::State*>& encState, MatD& encMem){
+  const int T = src.size();
+  const VecD init = VecD::Zero(this->enc->stateDim());
+  MatD xs, hs, hsRev;
+
+  this->enc->setState(init, encState[0]);
+  this->lookup(true, src, T, xs);
+
+  if (!this->bidirectional){
+    this->enc->forwardCheckpoint(xs, encState, this->checkpoint, hs);
+    encMem = hs.rightCols(T);
+    return;
+  }
+
+  std::vector<RNN::State*> encStateRev(encState.begin()+T+1, encState.begin()+2*T+2);
+
+  this->encRev->setState(init, encStateRev[0]);
+
+#pragma omp parallel sections num_threads(2)
+  {
+#pragma omp section
+    this->enc->forwardCheckpoint(xs, encState, this->checkpoint, hs);
+#pragma omp section
+    this->encRev->forwardCheckpoint(xs.rowwise().reverse(), encStateRev, this->checkpoint, hsRev);
+  }
+
+  //the same as encoderMemory
+  encMem = hs.rightCols(T)+hsRev.rightCols(T).rowwise().reverse();
+}
+
+void EncDec::initDecoder(const int srcLen, const std::vector<RNN::State*>& encState, RNN::State* decInit){
+  VecD s, sRev;
+
+  this->enc->getState(encState[srcLen], s);
+
+  if (this->bidirectional){
+    this->encRev->getState(encState[2*srcLen+1], sRev);
+    s += sRev;
+  }
+
+  this->dec->setState(s, decInit);
+}
+
+//the i-th column corresponds to src[i]
+void EncDec::encoderMemory(const int srcLen, const std::vector<RNN::State*>& encState, MatD& encMem){
+  encMem.resize(this->zeros.rows(), srcLen);
+
+  for (int i = 0; i < srcLen; ++i){
+    encMem.col(i) = encState[i+1]->h;
+
+    if (this->bidirectional){
+      encMem.col(i) += encState[2*srcLen+1-i]->h;
     }
   }
 }
 
-void EncDec::encode(const std::vector<int>& src, std::vector<LSTM::State*>& encState){
-  encState[0]->h = this->zeros;
-  encState[0]->c = this->zeros;
+//global attention (Luong et al., 2015) for all the decoder states in the columns of hs at once
+void EncDec::attend(const MatD& encMem, const MatD& hs, MatD& alpha, MatD& context, MatD& s){
+  const int H = hs.rows();
+
+  alpha.noalias() = encMem.transpose()*hs;
+
+  for (int j = 0; j < alpha.cols(); ++j){
+    alpha.col(j).array() -= alpha.col(j).maxCoeff(); //for numerical stability
+    alpha.col(j) = alpha.col(j).array().exp();
+    alpha.col(j) /= alpha.col(j).sum();
+  }
+
+  context.noalias() = encMem*alpha;
+  s = this->attn.bias.replicate(1, hs.cols());
+  s.noalias() += this->attn.weight.leftCols(H)*hs;
+  s.noalias() += this->attn.weight.rightCols(H)*context;
+  ActFunc::tanh(s);
+}
+
+void EncDec::attendBackward(const MatD& encMem, const MatD& hs, const MatD& alpha, const MatD& context, const MatD& s, const MatD& dels, MatD& delhs, MatD& delEncMem, Affine::Grad& grad){
+  const int H = hs.rows();
+  const MatD del = ActFunc::tanhPrime(s).array()*dels.array();
+  MatD delContext, delAlpha;
+
+  grad.weightGrad.leftCols(H).noalias() += del*hs.transpose();
+  grad.weightGrad.rightCols(H).noalias() += del*context.transpose();
+  grad.biasGrad += del.rowwise().sum();
+
+  delhs.noalias() = this->attn.weight.leftCols(H).transpose()*del;
+  delContext.noalias() = this->attn.weight.rightCols(H).transpose()*del;
+  delEncMem.noalias() = delContext*alpha.transpose();
+  delAlpha.noalias() = encMem.transpose()*delContext;
+
+  for (int j = 0; j < alpha.cols(); ++j){
+    delAlpha.col(j) = alpha.col(j).array()*(delAlpha.col(j).array()-alpha.col(j).dot(delAlpha.col(j)));
+  }
+
+  delhs.noalias() += encMem*delAlpha;
+  delEncMem.noalias() += hs*delAlpha.transpose();
+}
+
+//the embeddings of index[0], ..., index[length-1] as columns
+void EncDec::lookup(const MatD& embed, const std::vector<int>& index, const int length, MatD& xs){
+  xs.resize(embed.rows(), length);
+
+  for (int i = 0; i < length; ++i){
+    xs.col(i) = embed.col(index[i]);
+  }
+}
+
+void EncDec::lookup(const QuantMat& embed, const std::vector<int>& index, const int length, MatD& xs){
+  xs.resize(embed.cols, length);
+
+  for (int i = 0; i < length; ++i){
+    embed.row(index[i], xs.col(i).data());
+  }
+}
+
+void EncDec::lookup(const HalfMat& embed, const std::vector<int>& index, const int length, MatD& xs){
+  xs.resize(embed.cols, length);
+
+  for (int i = 0; i < length; ++i){
+    embed.row(index[i], xs.col(i).data());
+  }
+}
+
+void EncDec::lookup(const bool source, const std::vector<int>& index, const int length, MatD& xs){
+  if (this->quantized){
+    this->lookup(source ? this->sourceEmbedQ : this->targetEmbedQ, index, length, xs);
+  }
+  else if (this->halved){
+    this->lookup(source ? this->sourceEmbedH : this->targetEmbedH, index, length, xs);
+  }
+  else {
+    this->lookup(source ? this->sourceEmbed : this->targetEmbed, index, length, xs);
+  }
+}
+
+void EncDec::calcDist(const VecD& s, VecD& targetDist){
+  if (this->quantized || this->halved){
+    targetDist = (this->useBlackout ? this->blackout.bias : this->softmax.bias);
+
+    if (this->quantized){
+      QuantVec x;
+
+      x.quantize(s, this->outputQ.stride);
+      this->outputQ.gemv(x, targetDist);
+    }
+    else {
+      this->outputH.gemv(s, targetDist);
+    }
 
-  for (int i = 0; i < (int)src.size(); ++i){
-    this->enc.forward(this->sourceEmbed.col(src[i]), encState[i], encState[i+1]);
+    targetDist.array() -= targetDist.maxCoeff(); //for numerical stability
+    targetDist = targetDist.array().exp();
+    targetDist /= targetDist.array().sum();
+  }
+  else if (!this->useBlackout){
+    this->softmax.calcDist(s, targetDist);
+  }
+  else {
+    this->blackout.calcDist(s, targetDist);
   }
 }
 
+namespace {
 struct sort_pred {
-  bool operator()(const EncDec::DecCandidate left, const EncDec::DecCandidate right) {
-    return left.score > right.score;
+  bool operator()(const EncDec::DecCandidate& left, const EncDec::DecCandidate& right) {
+    return left.normScore > right.normScore;
   }
 
   bool operator()(const EncDec::Data* left, const EncDec::Data* right) {
@@ -70,81 +327,161 @@ struct sort_pred {
     //return left->tgt.size() < right->tgt.size();
   }
 };
+}
 
-void EncDec::translate(const std::vector<int>& src, const int beam, const int maxLength, const int showNum){
-  const Real minScore = -1.0e+05;
-  MatD score(this->targetEmbed.cols(), beam);
+Real EncDec::lengthNorm(const int length){
+  //length normalization of Wu et al. (2016)
+  return this->lengthPenalty > 0.0 ? pow((5.0+length)/6.0, this->lengthPenalty) : 1.0;
+}
+
+void EncDec::search(const std::vector<int>& src, const int beam, const int maxLength, EncDec::Workspace& ws, std::vector<EncDec::DecCandidate>& candidate){
+  const Real maxNorm = this->lengthNorm(maxLength);
   VecD targetDist;
-  std::vector<LSTM::State*> encState, stateList;
-  std::vector<EncDec::DecCandidate> candidate(beam), candidateTmp(beam);
+  std::vector<EncDec::DecCandidate> live(1), liveTmp;
+  std::vector<std::pair<Real, int> > top(this->targetVoc.tokenList.size());
+  std::vector<std::pair<Real, std::pair<int, int> > > expansion; //(score, (word, candidate))
+  std::vector<RNN::State*>& encState = ws.encState;
+  MatD hs, alpha, context, s;
+  VecD x;
+  Real bestFinished = -REAL_MAX;
+
+  ws.reset(*this->enc, this->encStateNum(src.size()));
+  candidate.clear();
+
+  if (this->encCache == 0 || !this->encCache->get(src, *this->enc, encState)){
+    this->encode(src, encState);
+
+    if (this->encCache != 0){
+      this->encCache->put(src, *this->enc, encState, this->encStateNum(src.size()));
+    }
+  }
 
-  for (int i = 0; i <= (int)src.size(); ++i){
-    encState.push_back(new LSTM::State);
-    stateList.push_back(encState.back());
+  if (this->useAttention){
+    this->encoderMemory(src.size(), encState, ws.encMem);
   }
 
-  this->encode(src, encState);
+  for (int i = 0; i < maxLength && !live.empty(); ++i){
+    const int K = std::min(beam, (int)top.size());
 
-  for (int i = 0; i < maxLength; ++i){
-    for (int j = 0; j < beam; ++j){
-      if (candidate[j].stop){
-	score.col(j).fill(candidate[j].score);
-	continue;
-      }
+    expansion.clear();
 
-      candidate[j].decState.push_back(new LSTM::State);
-      stateList.push_back(candidate[j].decState.back());
+    //only the live hypotheses are expanded; the finished ones are kept in candidate
+    hs.resize(this->zeros.rows(), live.size());
+
+    for (int j = 0; j < (int)live.size(); ++j){
+      live[j].decState.push_back(ws.next(*this->dec));
 
       if (i == 0){
-	candidate[j].decState[i]->h = encState.back()->h;
-	candidate[j].decState[i]->c = encState.back()->c;
+	this->initDecoder(src.size(), encState, live[j].decState[i]);
       }
-      else {
-	this->dec.forward(this->targetEmbed.col(candidate[j].tgt[i-1]), candidate[j].decState[i-1], candidate[j].decState[i]);
+      else if (this->quantized){
+	x.resize(this->targetEmbedQ.cols);
+	this->targetEmbedQ.row(live[j].tgt[i-1], x.data());
+	this->dec->forward(x, live[j].decState[i-1], live[j].decState[i]);
       }
-
-      if (!this->useBlackout){
-	this->softmax.calcDist(candidate[j].decState[i]->h, targetDist);
+      else if (this->halved){
+	x.resize(this->targetEmbedH.cols);
+	this->targetEmbedH.row(live[j].tgt[i-1], x.data());
+	this->dec->forward(x, live[j].decState[i-1], live[j].decState[i]);
       }
       else {
-	this->blackout.calcDist(candidate[j].decState[i]->h, targetDist);
+	this->dec->forward(this->targetEmbed.col(live[j].tgt[i-1]), live[j].decState[i-1], live[j].decState[i]);
       }
 
-      score.col(j).array() = candidate[j].score+targetDist.array().log();
+      hs.col(j) = live[j].decState[i]->h;
+    }
+
+    //attention for all the live hypotheses at once
+    if (this->useAttention){
+      this->attend(ws.encMem, hs, alpha, context, s);
+    }
+    else {
+      s.swap(hs);
     }
 
-    for (int j = 0, row, col; j < beam; ++j){
-      score.maxCoeff(&row, &col);
-      candidateTmp[j] = candidate[col];
-      candidateTmp[j].score = score.coeff(row, col);
+    for (int j = 0; j < (int)live.size(); ++j){
+      this->calcDist(s.col(j), targetDist);
 
-      if (candidateTmp[j].stop){
-	score.col(col).fill(minScore);
-	continue;
+      for (int k = 0; k < (int)top.size(); ++k){
+	top[k].first = targetDist.coeff(k, 0);
+	top[k].second = k;
       }
 
-      if (row == this->targetVoc.eosIndex){
-	candidateTmp[j].stop = true;
+      std::partial_sort(top.begin(), top.begin()+K, top.end(), std::greater<std::pair<Real, int> >());
+
+      for (int k = 0; k < K; ++k){
+	expansion.push_back(std::pair<Real, std::pair<int, int> >(live[j].score+log(top[k].first), std::pair<int, int>(top[k].second, j)));
       }
+    }
 
-      candidateTmp[j].tgt.push_back(row);
+    std::sort(expansion.begin(), expansion.end(), std::greater<std::pair<Real, std::pair<int, int> > >());
+    liveTmp.clear();
 
-      if (i == 0){
-	score.row(row).fill(minScore);
+    const Real best = expansion[0].first;
+
+    for (int k = 0; k < std::min(beam, (int)expansion.size()); ++k){
+      const Real score = expansion[k].first;
+      const int row = expansion[k].second.first;
+      const int col = expansion[k].second.second;
+
+      //the expansions are sorted, so the rest are pruned as well
+      if ((this->pruneRelative > 0.0 && score < best+log(this->pruneRelative)) ||
+	  (this->pruneAbsolute > 0.0 && score < best-this->pruneAbsolute)){
+	break;
+      }
+
+      EncDec::DecCandidate* cand;
+
+      if (row == this->targetVoc.eosIndex){
+	candidate.push_back(live[col]);
+	cand = &candidate.back();
+	cand->stop = true;
       }
       else {
-	score.coeffRef(row, col) = minScore;
+	liveTmp.push_back(live[col]);
+	cand = &liveTmp.back();
+      }
+
+      cand->score = score;
+      cand->tgt.push_back(row);
+
+      if (cand->stop){
+	bestFinished = std::max(bestFinished, cand->score/this->lengthNorm(cand->tgt.size()));
       }
     }
 
-    candidate = candidateTmp;
-    std::sort(candidate.begin(), candidate.end(), sort_pred());
+    live.swap(liveTmp);
 
-    if (candidate[0].tgt.back() == this->targetVoc.eosIndex){
-      break;
+    //the log probability only decreases, so no live hypothesis can beat the best finished one
+    if (!candidate.empty()){
+      Real bound = -REAL_MAX;
+
+      for (auto it = live.begin(); it != live.end(); ++it){
+	bound = std::max(bound, it->score/maxNorm);
+      }
+
+      if (bound <= bestFinished){
+	break;
+      }
     }
   }
 
+  //unfinished hypotheses when reaching maxLength
+  candidate.insert(candidate.end(), live.begin(), live.end());
+
+  for (auto it = candidate.begin(); it != candidate.end(); ++it){
+    it->normScore = it->score/this->lengthNorm(it->tgt.size());
+  }
+
+  std::sort(candidate.begin(), candidate.end(), sort_pred());
+}
+
+void EncDec::translate(const std::vector<int>& src, const int beam, const int maxLength, const int showNum){
+  EncDec::Workspace ws;
+  std::vector<EncDec::DecCandidate> candidate;
+
+  this->search(src, beam, maxLength, ws, candidate);
+
   if (showNum <= 0){
     return;
   }
@@ -154,173 +491,199 @@ void EncDec::translate(const std::vector<int>& src, const int beam, const int ma
   }
   std::cout << std::endl;
 
-  for (int i = 0; i < showNum; ++i){
+  for (int i = 0; i < std::min(showNum, (int)candidate.size()); ++i){
     std::cout << i+1 << " (" << candidate[i].score << "): ";
     for (auto it = candidate[i].tgt.begin(); it != candidate[i].tgt.end(); ++it){
       std::cout << this->targetVoc.tokenList[*it]->str << " ";
     }
     std::cout << std::endl;
   }
-
-  for (auto it = stateList.begin(); it != stateList.end(); ++it){
-    delete *it;
-  }
 }
 
 bool EncDec::translate(std::vector<int>& output, const std::vector<int>& src, const int beam, const int maxLength){
-  const Real minScore = -1.0e+05;
-  MatD score(this->targetEmbed.cols(), beam);
-  VecD targetDist;
-  std::vector<LSTM::State*> encState, stateList;
-  std::vector<EncDec::DecCandidate> candidate(beam), candidateTmp(beam);
+  EncDec::Workspace ws;
+
+  return this->translate(output, src, beam, maxLength, ws);
+}
+
+bool EncDec::translate(std::vector<int>& output, const std::vector<int>& src, const int beam, const int maxLength, EncDec::Workspace& ws){
+  PROFILE_SCOPE(Profiler::SEARCH, src.size());
+  std::vector<EncDec::DecCandidate> candidate;
+
+  this->search(src, beam, maxLength, ws, candidate);
+  output.clear();
+
+  if (candidate[0].tgt.back() == this->targetVoc.eosIndex){
+    for (int i = 0; i < (int)candidate[0].tgt.size()-1; ++i){
+      output.push_back(candidate[0].tgt[i]);
+    }
 
-  for (int i = 0; i <= (int)src.size(); ++i){
-    encState.push_back(new LSTM::State);
-    stateList.push_back(encState.back());
+    return true;
   }
 
-  this->encode(src, encState);
+  output = candidate[0].tgt;
+  return false;
+}
 
-  for (int i = 0; i < maxLength; ++i){
-    for (int j = 0; j < beam; ++j){
-      if (candidate[j].stop){
-	score.col(j).fill(candidate[j].score);
-	continue;
-      }
+void EncDec::translate(const std::string& inputFile, const std::string& outputFile, const int beam, const int maxLength, const int numThreads, const int tokenBudget){
+  std::ifstream ifs(inputFile.c_str());
+  std::ofstream ofs(outputFile.c_str());
+  std::vector<std::vector<int> > input;
+  std::vector<BatchScheduler::Batch> batches;
+  BatchScheduler scheduler(tokenBudget);
+  std::vector<EncDec::Workspace*> ws;
+  std::vector<int> node;
+  std::map<int, std::string> pending; //reorder buffer
+  std::vector<std::string> tokens;
+  int next = 0, srcTokens = 0, tgtTokens = 0, decSteps = 0;
+  struct timeval start, end;
+  const std::vector<int> masterCpu = Numa::affinity(); //the master thread is pinned as thread 0 below
 
-      candidate[j].decState.push_back(new LSTM::State);
-      stateList.push_back(candidate[j].decState.back());
+  assert(ifs && ofs);
 
-      if (i == 0){
-	candidate[j].decState[i]->h = encState.back()->h;
-	candidate[j].decState[i]->c = encState.back()->c;
-      }
-      else {
-	this->dec.forward(this->targetEmbed.col(candidate[j].tgt[i-1]), candidate[j].decState[i-1], candidate[j].decState[i]);
-      }
+  for (std::string line; std::getline(ifs, line); ){
+    input.push_back(std::vector<int>());
+    Utils::split(line, tokens);
 
-      if (!this->useBlackout){
-	this->softmax.calcDist(candidate[j].decState[i]->h, targetDist);
-      }
-      else {
-	this->blackout.calcDist(candidate[j].decState[i]->h, targetDist);
-      }
+    for (auto it = tokens.begin(); it != tokens.end(); ++it){
+      input.back().push_back(this->sourceVoc.tokenIndex.count(*it) ? this->sourceVoc.tokenIndex.at(*it) : this->sourceVoc.unkIndex);
+    }
+
+    input.back().push_back(this->sourceVoc.eosIndex);
+    srcTokens += input.back().size();
+  }
 
-      score.col(j).array() = candidate[j].score+targetDist.array().log();
+  ws.resize(numThreads);
+  node.resize(numThreads, 0);
+
+  //each thread allocates its own workspace, on its node when pinned
+#pragma omp parallel num_threads(numThreads)
+  {
+    const int id = omp_get_thread_num();
+
+    if (this->pinThreads){
+      node[id] = std::max(Numa::pin(id), 0);
     }
 
-    for (int j = 0, row, col; j < beam; ++j){
-      score.maxCoeff(&row, &col);
-      candidateTmp[j] = candidate[col];
-      candidateTmp[j].score = score.coeff(row, col);
+    ws[id] = new EncDec::Workspace;
+  }
 
-      if (candidateTmp[j].stop){
-	score.col(col).fill(minScore);
-	continue;
-      }
+  gettimeofday(&start, 0);
 
-      if (row == this->targetVoc.eosIndex){
-	candidateTmp[j].stop = true;
-      }
+  //sentences of similar lengths are translated together by the same thread
+  scheduler.schedule(input, batches);
 
-      candidateTmp[j].tgt.push_back(row);
+#pragma omp parallel for num_threads(numThreads) schedule(dynamic) shared(ws, node, batches, pending, next, tgtTokens, decSteps)
+  for (int b = 0; b < (int)batches.size(); ++b){
+    EncDec::Workspace& w = *ws[omp_get_thread_num()];
+    EncDec* model = (this->replica.empty() ? this : this->replica[node[omp_get_thread_num()]%this->replica.size()]);
 
-      if (i == 0){
-	score.row(row).fill(minScore);
+    for (auto id = batches[b].id.begin(); id != batches[b].id.end(); ++id){
+      std::vector<int> output;
+      std::ostringstream oss;
+
+      model->translate(output, input[*id], beam, maxLength, w);
+
+      for (auto it = output.begin(); it != output.end(); ++it){
+	oss << this->targetVoc.tokenList[*it]->str << (it+1 == output.end() ? "" : " ");
       }
-      else {
-	score.coeffRef(row, col) = minScore;
+
+#pragma omp critical (ReorderBuffer)
+      {
+	pending[*id] = oss.str();
+	tgtTokens += output.size();
+	decSteps += w.used;
+
+	//flush the translations in the input order
+	for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.begin()){
+	  ofs << it->second << std::endl;
+	  pending.erase(it);
+	  ++next;
+	}
       }
     }
+  }
 
-    candidate = candidateTmp;
-    std::sort(candidate.begin(), candidate.end(), sort_pred());
+  gettimeofday(&end, 0);
 
-    if (candidate[0].tgt.back() == this->targetVoc.eosIndex){
-      break;
-    }
+  if (this->pinThreads){
+    Numa::setAffinity(masterCpu);
   }
 
-  bool status;
+  const Real elapsed = (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06;
 
-  output.clear();
-
-  if (candidate[0].tgt.back() == this->targetVoc.eosIndex){
-    for (int i = 0; i < (int)candidate[0].tgt.size()-1; ++i){
-      output.push_back(candidate[0].tgt[i]);
-    }
+  std::cout << "Translated " << input.size() << " sentences (" << batches.size() << " batches) with " << numThreads << " threads in " << elapsed << " sec." << std::endl;
+  std::cout << "Sentences/sec:       " << input.size()/elapsed << std::endl;
+  std::cout << "Source tokens/sec:   " << srcTokens/elapsed << std::endl;
+  std::cout << "Target tokens/sec:   " << tgtTokens/elapsed << std::endl;
+  std::cout << "Decoder steps/sentence: " << (Real)decSteps/input.size() << std::endl;
+  PROFILE_FLUSH();
 
-    status = true;
-  }
-  else {
-    output = candidate[0].tgt;
-    status = false;
+  for (auto it = ws.begin(); it != ws.end(); ++it){
+    delete *it;
   }
+}
 
-  for (auto it = stateList.begin(); it != stateList.end(); ++it){
-    delete *it;
+//inputs to the output layer: the attentional hidden states, or the decoder hidden states themselves
+void EncDec::decoderOutput(EncDec::Data* data, const std::vector<RNN::State*>& encState, const std::vector<RNN::State*>& decState, MatD& s){
+  MatD hs(this->zeros.rows(), data->tgt.size());
+
+  for (int i = 0; i < (int)data->tgt.size(); ++i){
+    hs.col(i) = decState[i]->h;
   }
 
-  return status;
+  if (this->useAttention){
+    MatD encMem, alpha, context;
+
+    this->encoderMemory(data->src.size(), encState, encMem);
+    this->attend(encMem, hs, alpha, context, s);
+  }
+  else {
+    s.swap(hs);
+  }
 }
 
-Real EncDec::calcLoss(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState){
+Real EncDec::calcLoss(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState){
   VecD targetDist;
+  MatD xs, s;
   Real loss = 0.0;
 
   this->encode(data->src, encState);
+  this->initDecoder(data->src.size(), encState, decState[0]);
+  this->lookup(false, data->tgt, data->tgt.size()-1, xs);
+  this->dec->forwardSeq(xs, decState);
 
-  for (int i = 0; i < (int)data->tgt.size(); ++i){
-    if (i == 0){
-      decState[0]->h = encState[data->src.size()]->h;
-      decState[0]->c = encState[data->src.size()]->c;
-    }
-    else {
-      this->dec.forward(this->targetEmbed.col(data->tgt[i-1]), decState[i-1], decState[i]);
-    }
+  this->decoderOutput(data, encState, decState, s);
 
-    if (!this->useBlackout){
-      this->softmax.calcDist(decState[i]->h, targetDist);
-      loss += this->softmax.calcLoss(targetDist, data->tgt[i]);
-    }
-    else {
-      this->blackout.calcDist(decState[i]->h, targetDist);
-      loss += this->blackout.calcLoss(targetDist, data->tgt[i]);
-    }
+  for (int i = 0; i < (int)data->tgt.size(); ++i){
+    this->calcDist(s.col(i), targetDist);
+    loss -= log(targetDist.coeff(data->tgt[i], 0));
   }
   
   return loss;
 }
 
-Real EncDec::calcPerplexity(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState){
+Real EncDec::calcPerplexity(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState){
   VecD targetDist;
+  MatD xs, s;
   Real perp = 0.0;
 
   this->encode(data->src, encState);
+  this->initDecoder(data->src.size(), encState, decState[0]);
+  this->lookup(false, data->tgt, data->tgt.size()-1, xs);
+  this->dec->forwardSeq(xs, decState);
 
-  for (int i = 0; i < (int)data->tgt.size(); ++i){
-    if (i == 0){
-      decState[0]->h = encState[data->src.size()]->h;
-      decState[0]->c = encState[data->src.size()]->c;
-    }
-    else {
-      this->dec.forward(this->targetEmbed.col(data->tgt[i-1]), decState[i-1], decState[i]);
-    }
-
-    if (!this->useBlackout){
-      this->softmax.calcDist(decState[i]->h, targetDist);
-    }
-    else {
-      this->blackout.calcDist(decState[i]->h, targetDist);
-    }
+  this->decoderOutput(data, encState, decState, s);
 
+  for (int i = 0; i < (int)data->tgt.size(); ++i){
+    this->calcDist(s.col(i), targetDist);
     perp -= log(targetDist.coeff(data->tgt[i], 0));
   }
   
   return exp(perp/data->tgt.size());
 }
 
-void EncDec::gradCheck(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState, MatD& param, const MatD& grad){
+void EncDec::gradCheck(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState, MatD& param, const MatD& grad){
   const Real EPS = 1.0e-04;
   Real val = 0.0, objPlus = 0.0, objMinus = 0.0;
 
@@ -339,67 +702,160 @@ void EncDec::gradCheck(EncDec::Data* data, std::vector<LSTM::State*>& encState,
   }
 }
 
-void EncDec::gradCheck(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState, EncDec::Grad& grad){
+void EncDec::gradCheck(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState, EncDec::Grad& grad){
+  LSTM* lstm = dynamic_cast<LSTM*>(this->enc);
+
   std::cout << "Gradient checking..." << std::endl;
-  this->gradCheck(data, encState, decState, this->enc.Whi, grad.lstmSrcGrad.Whi);
+
+  if (lstm != 0){
+    this->gradCheck(data, encState, decState, lstm->Whi, ((LSTM::Grad*)grad.encGrad)->Whi);
+  }
+  else {
+    std::cout << "Skipped: the check is for the LSTM encoder (Whi) only" << std::endl;
+  }
 }
 
-void EncDec::train(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState, EncDec::Grad& grad, Real& loss){
-  VecD targetDist;
+void EncDec::train(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState, EncDec::Grad& grad, Real& loss){
+  const int T = data->src.size();
+  VecD targetDist, delFeature;
+  VecD delInit;
+  MatD xs;
+  MatD encMem, hs, alpha, context, s, dels, delhs, delEncMem;
+  unsigned long bytes = 0;
 
   loss = 0.0;
-  this->encode(data->src, encState);
 
-  for (int i = 0; i < (int)data->tgt.size(); ++i){
-    if (i == 0){
-      decState[0]->h = encState[data->src.size()]->h;
-      decState[0]->c = encState[data->src.size()]->c;
+  {
+    PROFILE_SCOPE(Profiler::ENCODE, T);
+    this->encode(data->src, encState, encMem);
+  }
+
+  {
+    PROFILE_SCOPE(Profiler::DECODE, data->tgt.size());
+    this->initDecoder(T, encState, decState[0]);
+    this->lookup(this->targetEmbed, data->tgt, data->tgt.size()-1, xs);
+    this->dec->forwardCheckpoint(xs, decState, this->checkpoint, hs);
+
+    //the activations kept by the forward pass (the high-water mark before backward, with the segments recomputed there)
+    bytes = sizeof(Real)*(hs.size()+(this->useAttention ? encMem.size() : 0));
+
+    for (int i = 0; i < this->encStateNum(T); ++i){
+      bytes += encState[i]->bytes();
     }
-    else {
-      this->dec.forward(this->targetEmbed.col(data->tgt[i-1]), decState[i-1], decState[i]);
+    for (int i = 0; i < (int)data->tgt.size(); ++i){
+      bytes += decState[i]->bytes();
     }
 
-    if (!this->useBlackout){
-      this->softmax.calcDist(decState[i]->h, targetDist);
-      loss += this->softmax.calcLoss(targetDist, data->tgt[i]);
-      this->softmax.backward(decState[i]->h, targetDist, data->tgt[i], decState[i]->delh, grad.softmaxGrad);
+    if (this->useAttention){
+      this->attend(encMem, hs, alpha, context, s);
     }
     else {
-      this->blackout.sampling(data->tgt[i], grad.blackoutState);
-      this->blackout.calcSampledDist(decState[i]->h, targetDist, grad.blackoutState);
-      loss += this->blackout.calcSampledLoss(targetDist);
-      this->blackout.backward(decState[i]->h, targetDist, grad.blackoutState, decState[i]->delh, grad.blackoutGrad);
+      s = hs;
     }
   }
 
-  decState[data->tgt.size()-1]->delc = this->zeros;
+  {
+    PROFILE_SCOPE(Profiler::OUTPUT, data->tgt.size());
+    dels.resize(s.rows(), s.cols());
 
-  for (int i = data->tgt.size()-1; i >= 1; --i){
-    decState[i-1]->delc = this->zeros;
-    this->dec.backward(decState[i-1], decState[i], grad.lstmTgtGrad, this->targetEmbed.col(data->tgt[i-1]));
+    for (int i = 0; i < (int)data->tgt.size(); ++i){
+      if (!this->useBlackout){
+	this->softmax.calcDist(s.col(i), targetDist);
+	loss += this->softmax.calcLoss(targetDist, data->tgt[i]);
+	this->softmax.backward(s.col(i), targetDist, data->tgt[i], delFeature, grad.softmaxGrad);
+      }
+      else {
+	this->blackout.sampling(data->tgt[i], grad.blackoutState);
+	this->blackout.calcSampledDist(s.col(i), targetDist, grad.blackoutState);
+	loss += this->blackout.calcSampledLoss(targetDist);
+	this->blackout.backward(s.col(i), targetDist, grad.blackoutState, delFeature, grad.blackoutGrad);
+      }
 
-    if (grad.targetEmbed.count(data->tgt[i-1])){
-      grad.targetEmbed.at(data->tgt[i-1]) += decState[i]->delx;
-    }
-    else {
-      grad.targetEmbed[data->tgt[i-1]] = decState[i]->delx;
+      dels.col(i) = delFeature;
     }
   }
-  
-  encState[data->src.size()]->delc = decState[0]->delc;
-  encState[data->src.size()]->delh = decState[0]->delh;
 
-  for (int i = data->src.size(); i >= 1; --i){
-    encState[i-1]->delh = this->zeros;
-    encState[i-1]->delc = this->zeros;
-    this->enc.backward(encState[i-1], encState[i], grad.lstmSrcGrad, this->sourceEmbed.col(data->src[i-1]));
+  PROFILE_SCOPE(Profiler::BACKWARD, T+data->tgt.size()); //until the end
 
-    if (grad.sourceEmbed.count(data->src[i-1])){
-      grad.sourceEmbed.at(data->src[i-1]) += encState[i]->delx;
-    }
-    else {
-      grad.sourceEmbed[data->src[i-1]] = encState[i]->delx;
-    }
+  unsigned long decPeak = 0, encPeak = 0, encRevPeak = 0;
+
+  if (this->useAttention){
+    this->attendBackward(encMem, hs, alpha, context, s, dels, delhs, delEncMem, grad.attnGrad);
+  }
+  else {
+    delhs.swap(dels);
+    delEncMem = MatD::Zero(hs.rows(), T);
+  }
+
+  for (int i = 0; i < (int)data->tgt.size(); ++i){
+    decState[i]->delh = delhs.col(i);
+  }
+
+  this->dec->setStateGrad(VecD::Zero(this->dec->stateDim()), decState[data->tgt.size()-1]);
+  decPeak = this->dec->backwardCheckpoint(xs, decState, *grad.decGrad, this->checkpoint);
+
+  for (int i = data->tgt.size()-1; i >= 1; --i){
+    if (grad.targetEmbed.count(data->tgt[i-1])){
+      grad.targetEmbed.at(data->tgt[i-1]) += decState[i]->delx;
+    }
+    else {
+      grad.targetEmbed[data->tgt[i-1]] = decState[i]->delx;
+    }
+  }
+  
+  std::vector<RNN::State*> encStateRev;
+  MatD xsRev;
+
+  //the encoder hidden states receive the gradients from the attention as well
+  encState[0]->delh = this->zeros;
+
+  for (int i = 1; i <= T; ++i){
+    encState[i]->delh = delEncMem.col(i-1);
+  }
+
+  this->dec->getStateGrad(decState[0], delInit);
+  this->enc->setStateGrad(delInit, encState[T]);
+
+  this->lookup(this->sourceEmbed, data->src, T, xs);
+
+  if (this->bidirectional){
+    encStateRev.assign(encState.begin()+T+1, encState.begin()+2*T+2);
+    encStateRev[0]->delh = this->zeros;
+
+    for (int i = 1; i <= T; ++i){
+      encStateRev[i]->delh = delEncMem.col(T-i);
+    }
+
+    this->encRev->setStateGrad(delInit, encStateRev[T]);
+
+    xsRev = xs.rowwise().reverse();
+  }
+
+#pragma omp parallel sections num_threads(2) if(this->bidirectional)
+  {
+#pragma omp section
+    encPeak = this->enc->backwardCheckpoint(xs, encState, *grad.encGrad, this->checkpoint);
+#pragma omp section
+    if (this->bidirectional){
+      encRevPeak = this->encRev->backwardCheckpoint(xsRev, encStateRev, *grad.encRevGrad, this->checkpoint);
+    }
+  }
+
+  //the two directions are recomputed at the same time
+  grad.activationBytes = std::max(grad.activationBytes, bytes+std::max(decPeak, encPeak+encRevPeak));
+
+  for (int i = T; i >= 1; --i){
+    if (grad.sourceEmbed.count(data->src[i-1])){
+      grad.sourceEmbed.at(data->src[i-1]) += encState[i]->delx;
+    }
+    else {
+      grad.sourceEmbed[data->src[i-1]] = encState[i]->delx;
+    }
+
+    //encStateRev[T-i+1] reads src[i-1]
+    if (this->bidirectional){
+      grad.sourceEmbed.at(data->src[i-1]) += encStateRev[T-i+1]->delx;
+    }
   }
 }
 
@@ -407,18 +863,45 @@ void EncDec::trainOpenMP(const Real learningRate, const int miniBatchSize, const
   static std::vector<EncDec::ThreadArg*> args;
   static std::vector<std::pair<int, int> > miniBatch;
   static EncDec::Grad grad;
+  static std::vector<ParamRegistry*> threadDense;
+  static std::vector<EncDec::Grad*> part; //partitions of the sparse gradients
   Real lossTrain = 0.0, perpDev = 0.0, denom = 0.0;
-  Real gradNorm, lr = learningRate;
+  Real gradNorm, sqNorm, clip, lr = learningRate;
   const Real clipThreshold = 3.0;
   struct timeval start, end;
+  const std::vector<int> masterCpu = Numa::affinity(); //the master thread runs as the pinned thread 0 until the updates are done
+
+  if (this->encCache != 0){
+    this->encCache->clear(); //the cached states are stale after the update
+  }
 
   if (args.empty()){
-    for (int i = 0; i < numThreads; ++i){
-      args.push_back(new EncDec::ThreadArg(*this));
+    int srcLen = 0, tgtLen = 0;
+
+    for (auto it = this->trainData.begin(); it != this->trainData.end(); ++it){
+      srcLen = std::max(srcLen, (int)(*it)->src.size());
+      tgtLen = std::max(tgtLen, (int)(*it)->tgt.size());
+    }
+
+    args.resize(numThreads);
 
-      for (int j = 0; j < 200; ++j){
-	args[i]->encState.push_back(new LSTM::State);
-	args[i]->decState.push_back(new LSTM::State);
+    //each thread allocates (and first touches) its own gradients and states, on its node when pinned
+#pragma omp parallel num_threads(numThreads)
+    {
+      const int id = omp_get_thread_num();
+
+      if (this->pinThreads){
+	Numa::pin(id);
+      }
+
+      args[id] = new EncDec::ThreadArg(*this);
+
+      //enough for the longest pair (2T+2 encoder states when bidirectional)
+      for (int j = 0; j < this->encStateNum(srcLen); ++j){
+	args[id]->encState.push_back(this->enc->newState());
+      }
+      for (int j = 0; j < tgtLen; ++j){
+	args[id]->decState.push_back(this->dec->newState());
       }
     }
 
@@ -426,72 +909,183 @@ void EncDec::trainOpenMP(const Real learningRate, const int miniBatchSize, const
       miniBatch.push_back(std::pair<int, int>(i*miniBatchSize, (i == step-1 ? this->trainData.size()-1 : (i+1)*miniBatchSize-1)));
     }
 
-    grad.lstmSrcGrad = LSTM::Grad(this->enc);
-    grad.lstmTgtGrad = LSTM::Grad(this->dec);
+    grad.encGrad = this->enc->newGrad();
+    grad.decGrad = this->dec->newGrad();
+
+    if (this->bidirectional){
+      grad.encRevGrad = this->encRev->newGrad();
+    }
+
+    if (this->useAttention){
+      grad.attnGrad = Affine::Grad(this->attn);
+    }
     grad.softmaxGrad = SoftMax::Grad(this->softmax);
     grad.blackoutGrad = BlackOut::Grad();
 
+    this->registerParams(grad, numThreads);
+
+    for (int i = 0; i < numThreads; ++i){
+      this->registerParams(args[i]->grad, numThreads);
+      threadDense.push_back(&args[i]->grad.dense);
+      part.push_back(new EncDec::Grad);
+    }
+
+    if (this->ring != 0 && !this->ring->open(grad.dense.size, this->rowCapacity())){
+      exit(1);
+    }
+
     //std::sort(this->trainData.begin(), this->trainData.end(), sort_pred());
   }
+  else if (this->pinThreads){
+    Numa::pin(0); //the other threads of the pool stay pinned from the first call
+  }
 
   //this->rnd.shuffle(miniBatch);
   this->rnd.shuffle(this->trainData);
   gettimeofday(&start, 0);
 
+  const bool async = (this->asynchronous && this->optimizer.type == Optimizer::SGD && this->ring == 0);
+  const int rank = (this->ring != 0 ? this->ring->rank : 0);
+  const int procNum = (this->ring != 0 ? this->ring->size : 1);
+  unsigned long trained = (async ? this->trainData.size() : 0); //# of the sentences trained by this process
   int count = 0;
 
-  for (auto it = miniBatch.begin(); it != miniBatch.end(); ++it){
+  if (this->asynchronous && !async){
+    std::cerr << "Asynchronous training supports SGD in a single process only; the updates are synchronized" << std::endl;
+  }
+
+  if (async){
+    this->trainAsync(miniBatch, args, learningRate, miniBatchSize, numThreads);
+
+    for (int id = 0; id < numThreads; ++id){
+      lossTrain += args[id]->loss;
+      args[id]->loss = 0.0;
+    }
+  }
+
+  //synchronous updates after merging the gradients of all the threads
+  for (auto it = miniBatch.begin(); !async && it != miniBatch.end(); ++it){
     std::cout << "\r"
 	      << "Progress: " << ++count << "/" << miniBatch.size() << " mini batches" << std::flush;
 
+    if (it->first+rank <= it->second){
+      trained += (it->second-it->first-rank)/procNum+1;
+    }
+
+    //each thread accumulates into its own states and gradients (args[id]), which are merged below
 #pragma omp parallel for num_threads(numThreads) schedule(dynamic) shared(args)
-    for (int i = it->first; i <= it->second; ++i){
-      int id = 0;//omp_get_thread_num();
+    for (int i = it->first+rank; i <= it->second; i += procNum){
+      const int id = omp_get_thread_num();
       Real loss;
       this->train(this->trainData[i], args[id]->encState, args[id]->decState, args[id]->grad, loss);
       args[id]->loss += loss;
     }
 
-    for (int id = 0; id < numThreads; ++id){
-      grad += args[id]->grad;
-      args[id]->grad.init();
-      lossTrain += args[id]->loss;
-      args[id]->loss = 0.0;
+    {
+      PROFILE_SCOPE(Profiler::MERGE, numThreads);
+
+      sqNorm = grad.dense.reduce(threadDense);
+
+#pragma omp parallel for num_threads(numThreads) schedule(static) reduction(+:sqNorm)
+      for (int p = 0; p < numThreads; ++p){
+	sqNorm += this->reduceRows(args, p, numThreads, *part[p]);
+      }
+
+#pragma omp parallel for num_threads(numThreads) schedule(static)
+      for (int id = 0; id < numThreads; ++id){
+	args[id]->grad.initRows();
+      }
+
+      if (this->ring != 0){
+	//the processes have the same sums (and thus the same parameters) after this
+	this->ring->allreduce(grad.dense);
+	sqNorm = grad.dense.squaredNorm()+this->exchangeRows(part, numThreads);
+      }
+
+      for (int id = 0; id < numThreads; ++id){
+	lossTrain += args[id]->loss;
+	args[id]->loss = 0.0;
+      }
     }
 
-    gradNorm = sqrt(grad.norm())/miniBatchSize;
+    PROFILE_SCOPE(Profiler::SGD, it->second-it->first+1);
+
+    gradNorm = sqrt(sqNorm)/miniBatchSize;
     Utils::infNan(gradNorm);
-    lr = (gradNorm > clipThreshold ? clipThreshold*learningRate/gradNorm : learningRate);
-    lr /= miniBatchSize;
+    clip = (gradNorm > clipThreshold ? clipThreshold/gradNorm : 1.0);
+
+    if (this->optimizer.type != Optimizer::SGD){
+      //the optimizer takes the clipped mean gradient (the moments see the clipped values, as SGD does)
+      lr = learningRate;
+      this->optimizer.step(clip/miniBatchSize);
 
-    this->enc.sgd(grad.lstmSrcGrad, lr);
-    this->dec.sgd(grad.lstmTgtGrad, lr);
+      //the moments of the sparse parameters are allocated before the parallel updates
+      this->optimizer.moment("sourceEmbed", this->sourceEmbed.rows(), this->sourceEmbed.cols());
+      this->optimizer.moment("targetEmbed", this->targetEmbed.rows(), this->targetEmbed.cols());
 
-    if (!this->useBlackout){
-      this->softmax.sgd(grad.softmaxGrad, lr);
+      if (this->useBlackout){
+	this->optimizer.moment("blackout.weight", this->blackout.weight.rows(), this->blackout.weight.cols());
+	this->optimizer.moment("blackout.bias", this->blackout.bias.rows(), 1);
+      }
     }
     else {
-      this->blackout.sgd(grad.blackoutGrad, lr);
+      lr = clip*learningRate/miniBatchSize;
     }
 
-    for (auto it = grad.sourceEmbed.begin(); it != grad.sourceEmbed.end(); ++it){
-      this->sourceEmbed.col(it->first) -= lr*it->second;
+    grad.dense.update(this->optimizer, lr);
+
+#pragma omp parallel for num_threads(numThreads) schedule(static)
+    for (int p = 0; p < numThreads; ++p){
+      this->updatePart(*part[p], lr);
     }
-    for (auto it = grad.targetEmbed.begin(); it != grad.targetEmbed.end(); ++it){
-      this->targetEmbed.col(it->first) -= lr*it->second;
+  }
+
+  std::cout << std::endl;
+  gettimeofday(&end, 0);
+
+  if (this->pinThreads){
+    Numa::setAffinity(masterCpu);
+  }
+
+  std::cout << "Training time for this epoch: " << ((end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06)/60.0 << " min." << std::endl;
+  std::cout << "Training Loss (/sentence):    " << lossTrain/trained << std::endl;
+
+  if (async){
+    unsigned long staleRows = 0;
+
+    for (int id = 0; id < numThreads; ++id){
+      staleRows += args[id]->staleRows;
+      args[id]->staleRows = 0;
     }
 
-    grad.init();
+    std::cout << "Asynchronous updates (stale embedding rows skipped): " << staleRows << std::endl;
+  }
+
+  unsigned long activationBytes = 0;
+
+  for (int id = 0; id < numThreads; ++id){
+    activationBytes = std::max(activationBytes, args[id]->grad.activationBytes);
+    args[id]->grad.activationBytes = 0;
+  }
+
+  std::cout << "Activation memory (max/sentence): " << activationBytes/1024.0 << " KB";
+
+  if (this->checkpoint > 1){
+    std::cout << " (checkpoints every " << this->checkpoint << " steps)";
   }
 
   std::cout << std::endl;
-  gettimeofday(&end, 0);
-  std::cout << "Training time for this epoch: " << (end.tv_sec-start.tv_sec)/60.0 << " min." << std::endl;
-  std::cout << "Training Loss (/sentence):    " << lossTrain/this->trainData.size() << std::endl;
+
+  if (rank > 0){
+    PROFILE_FLUSH(); //the development data is evaluated by rank 0 only
+    return;
+  }
+
   gettimeofday(&start, 0);
 
 #pragma omp parallel for num_threads(numThreads) schedule(dynamic) shared(perpDev, denom)
   for (int i = 0; i < (int)this->devData.size(); ++i){
+    PROFILE_SCOPE(Profiler::EVAL, this->devData[i]->tgt.size());
     Real perp = this->calcLoss(this->devData[i], this->encStateDev[i], this->decStateDev[i]);
     
     for (auto it = this->encStateDev[i].begin(); it != this->encStateDev[i].end(); ++it){
@@ -509,83 +1103,337 @@ void EncDec::trainOpenMP(const Real learningRate, const int miniBatchSize, const
   }
 
   gettimeofday(&end, 0);
-  std::cout << "Evaluation time for this epoch: " << (end.tv_sec-start.tv_sec)/60.0 << " min." << std::endl;
+  std::cout << "Evaluation time for this epoch: " << ((end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06)/60.0 << " min." << std::endl;
   std::cout << "Development loss (/sentence): " << perpDev/this->devData.size() << std::endl;
   std::cout << "Development perplexity (global): " << exp(perpDev/denom) << std::endl;
+  PROFILE_FLUSH();
 }
 
-void EncDec::demo(const std::string& srcTrain, const std::string& tgtTrain, const std::string& srcDev, const std::string& tgtDev){
-  const int threSource = 1;
-  const int threTarget = 1;
-  Vocabulary sourceVoc(srcTrain, threSource);
-  Vocabulary targetVoc(tgtTrain, threTarget);
-  std::vector<EncDec::Data*> trainData, devData;
-  std::ifstream ifsSrcTrain(srcTrain.c_str());
-  std::ifstream ifsTgtTrain(tgtTrain.c_str());
-  std::ifstream ifsSrcDev(srcDev.c_str());
-  std::ifstream ifsTgtDev(tgtDev.c_str());
-  std::vector<std::string> tokens;
-  int numLine = 0;
+void EncDec::trainAsync(const std::vector<std::pair<int, int> >& miniBatch, std::vector<EncDec::ThreadArg*>& args, const Real learningRate, const int miniBatchSize, const int numThreads){
+  const Real clipThreshold = 3.0;
+  int count = 0;
 
-  //training data
-  for (std::string line; std::getline(ifsSrcTrain, line); ){
-    trainData.push_back(new EncDec::Data);
-    Utils::split(line, tokens);
+  if (this->sourceVersion.size() != (unsigned int)this->sourceEmbed.cols()){
+    this->sourceVersion.assign(this->sourceEmbed.cols(), 0);
+  }
+  if (this->targetVersion.size() != (unsigned int)this->targetEmbed.cols()){
+    this->targetVersion.assign(this->targetEmbed.cols(), 0);
+  }
 
-    for (auto it = tokens.begin(); it != tokens.end(); ++it){
-      trainData.back()->src.push_back(sourceVoc.tokenIndex.count(*it) ? sourceVoc.tokenIndex.at(*it) : sourceVoc.unkIndex);
+  //each mini batch is processed by one thread, which then updates the shared parameters in place without locks
+#pragma omp parallel for num_threads(numThreads) schedule(dynamic) shared(args, count)
+  for (int k = 0; k < (int)miniBatch.size(); ++k){
+    EncDec::ThreadArg* arg = args[omp_get_thread_num()];
+    Real loss, gradNorm, lr;
+
+#pragma omp critical
+    {
+      std::cout << "\r"
+		<< "Progress: " << ++count << "/" << miniBatch.size() << " mini batches" << std::flush;
+    }
+
+    if (this->maxStaleness >= 0){
+      for (int i = miniBatch[k].first; i <= miniBatch[k].second; ++i){
+	for (auto it = this->trainData[i]->src.begin(); it != this->trainData[i]->src.end(); ++it){
+	  unsigned int version;
+#pragma omp atomic read
+	  version = this->sourceVersion[*it];
+	  arg->sourceVersion.insert(std::pair<int, unsigned int>(*it, version));
+	}
+	for (auto it = this->trainData[i]->tgt.begin(); it != this->trainData[i]->tgt.end(); ++it){
+	  unsigned int version;
+#pragma omp atomic read
+	  version = this->targetVersion[*it];
+	  arg->targetVersion.insert(std::pair<int, unsigned int>(*it, version));
+	}
+      }
+    }
+
+    for (int i = miniBatch[k].first; i <= miniBatch[k].second; ++i){
+      this->train(this->trainData[i], arg->encState, arg->decState, arg->grad, loss);
+      arg->loss += loss;
+    }
+
+    PROFILE_SCOPE(Profiler::SGD, miniBatch[k].second-miniBatch[k].first+1);
+
+    gradNorm = sqrt(arg->grad.norm())/miniBatchSize;
+    Utils::infNan(gradNorm);
+    lr = (gradNorm > clipThreshold ? clipThreshold*learningRate/gradNorm : learningRate);
+    lr /= miniBatchSize;
+
+    arg->grad.dense.sgd(lr);
+
+    if (this->useBlackout){
+      this->blackout.sgd(arg->grad.blackoutGrad, lr);
     }
 
-    //std::reverse(trainData.back()->src.begin(), trainData.back()->src.end());
-    trainData.back()->src.push_back(sourceVoc.eosIndex);
+    arg->staleRows += this->updateRows(arg->grad.sourceEmbed, lr, this->sourceEmbed, this->sourceVersion, arg->sourceVersion);
+    arg->staleRows += this->updateRows(arg->grad.targetEmbed, lr, this->targetEmbed, this->targetVersion, arg->targetVersion);
+    arg->sourceVersion.clear();
+    arg->targetVersion.clear();
+    arg->grad.init();
   }
+}
 
-  for (std::string line; std::getline(ifsTgtTrain, line); ){
-    Utils::split(line, tokens);
+unsigned long EncDec::updateRows(const std::unordered_map<int, VecD>& grad, const Real learningRate, MatD& embed,
+				 std::vector<unsigned int>& version, const std::unordered_map<int, unsigned int>& readVersion){
+  unsigned long res = 0;
 
-    for (auto it = tokens.begin(); it != tokens.end(); ++it){
-      trainData[numLine]->tgt.push_back(targetVoc.tokenIndex.count(*it) ? targetVoc.tokenIndex.at(*it) : targetVoc.unkIndex);
+  for (auto it = grad.begin(); it != grad.end(); ++it){
+    if (this->maxStaleness >= 0){
+      unsigned int cur;
+#pragma omp atomic read
+      cur = version[it->first];
+
+      if (cur-readVersion.at(it->first) > (unsigned int)this->maxStaleness){
+	++res;
+	continue;
+      }
     }
 
-    trainData[numLine]->tgt.push_back(targetVoc.eosIndex);
-    ++numLine;
+    embed.col(it->first) -= learningRate*it->second;
+
+    if (this->maxStaleness >= 0){
+#pragma omp atomic
+      ++version[it->first];
+    }
   }
 
-  //development data
-  numLine = 0;
+  return res;
+}
 
-  for (std::string line; std::getline(ifsSrcDev, line); ){
-    devData.push_back(new EncDec::Data);
-    Utils::split(line, tokens);
+static void addRows(const std::unordered_map<int, VecD>& grad, const int p, const int partNum, std::unordered_map<int, VecD>& res){
+  for (auto it = grad.begin(); it != grad.end(); ++it){
+    if (it->first%partNum != p){
+      continue;
+    }
 
-    for (auto it = tokens.begin(); it != tokens.end(); ++it){
-      devData.back()->src.push_back(sourceVoc.tokenIndex.count(*it) ? sourceVoc.tokenIndex.at(*it) : sourceVoc.unkIndex);
+    auto found = res.find(it->first);
+
+    if (found == res.end()){
+      res[it->first] = it->second;
     }
+    else {
+      found->second += it->second;
+    }
+  }
+}
+
+static Real rowNorm(EncDec::Grad& part){
+  Real res = part.blackoutGrad.norm();
 
-    //std::reverse(devData.back()->src.begin(), devData.back()->src.end());
-    devData.back()->src.push_back(sourceVoc.eosIndex);
+  for (auto it = part.sourceEmbed.begin(); it != part.sourceEmbed.end(); ++it){
+    res += it->second.squaredNorm();
+  }
+  for (auto it = part.targetEmbed.begin(); it != part.targetEmbed.end(); ++it){
+    res += it->second.squaredNorm();
   }
 
-  for (std::string line; std::getline(ifsTgtDev, line); ){
-    Utils::split(line, tokens);
+  return res;
+}
 
-    for (auto it = tokens.begin(); it != tokens.end(); ++it){
-      devData[numLine]->tgt.push_back(targetVoc.tokenIndex.count(*it) ? targetVoc.tokenIndex.at(*it) : targetVoc.unkIndex);
+Real EncDec::reduceRows(std::vector<EncDec::ThreadArg*>& args, const int p, const int partNum, EncDec::Grad& part){
+  for (auto arg = args.begin(); arg != args.end(); ++arg){
+    const EncDec::Grad& grad = (*arg)->grad;
+
+    addRows(grad.sourceEmbed, p, partNum, part.sourceEmbed);
+    addRows(grad.targetEmbed, p, partNum, part.targetEmbed);
+    addRows(grad.blackoutGrad.weight, p, partNum, part.blackoutGrad.weight);
+
+    for (auto it = grad.blackoutGrad.bias.begin(); it != grad.blackoutGrad.bias.end(); ++it){
+      if (it->first%partNum == p){
+	part.blackoutGrad.bias[it->first] += it->second;
+      }
     }
+  }
 
-    devData[numLine]->tgt.push_back(targetVoc.eosIndex);
-    ++numLine;
+  return rowNorm(part);
+}
+
+//the kinds of the rows in the regions of ShmRing: [kind, row, values...]
+enum ROW_KIND{
+  SOURCE_EMBED,
+  TARGET_EMBED,
+  BLACKOUT_WEIGHT,
+  BLACKOUT_BIAS,
+};
+
+static void writeRows(const std::unordered_map<int, VecD>& grad, const ROW_KIND kind, Real* buf, unsigned long& pos){
+  for (auto it = grad.begin(); it != grad.end(); ++it){
+    buf[pos++] = kind;
+    buf[pos++] = it->first;
+    memcpy(buf+pos, it->second.data(), sizeof(Real)*it->second.rows());
+    pos += it->second.rows();
   }
+}
+
+//the rows of the embeddings and BlackOut in total
+unsigned long EncDec::rowCapacity(){
+  unsigned long res = 1;
+
+  res += this->sourceEmbed.cols()*(2+this->sourceEmbed.rows());
+  res += this->targetEmbed.cols()*(2+this->targetEmbed.rows());
+
+  if (this->useBlackout){
+    res += this->blackout.weight.cols()*(2+this->blackout.weight.rows());
+    res += this->blackout.bias.rows()*3;
+  }
+
+  return res;
+}
+
+Real EncDec::exchangeRows(std::vector<EncDec::Grad*>& part, const int numThreads){
+  Real* buf = this->ring->rows(this->ring->rank);
+  unsigned long pos = 1;
+  Real res = 0.0;
+
+  for (auto p = part.begin(); p != part.end(); ++p){
+    writeRows((*p)->sourceEmbed, SOURCE_EMBED, buf, pos);
+    writeRows((*p)->targetEmbed, TARGET_EMBED, buf, pos);
+    writeRows((*p)->blackoutGrad.weight, BLACKOUT_WEIGHT, buf, pos);
+
+    for (auto it = (*p)->blackoutGrad.bias.begin(); it != (*p)->blackoutGrad.bias.end(); ++it){
+      buf[pos++] = BLACKOUT_BIAS;
+      buf[pos++] = it->first;
+      buf[pos++] = it->second;
+    }
+  }
+
+  buf[0] = pos;
+  this->ring->barrier();
+
+  //each partition is summed in the order of the ranks, to have the same result in all the processes
+#pragma omp parallel for num_threads(numThreads) schedule(static) reduction(+:res)
+  for (int p = 0; p < numThreads; ++p){
+    part[p]->initRows();
+
+    for (int r = 0; r < this->ring->size; ++r){
+      const Real* rows = this->ring->rows(r);
+
+      for (unsigned long i = 1, end = rows[0]; i < end; ){
+	const ROW_KIND kind = (ROW_KIND)rows[i];
+	const int row = rows[i+1];
+	const int dim = (kind == SOURCE_EMBED ? this->sourceEmbed.rows() : kind == TARGET_EMBED ? this->targetEmbed.rows() :
+			 kind == BLACKOUT_WEIGHT ? this->blackout.weight.rows() : 1);
+
+	i += 2;
+
+	if (row%numThreads != p){
+	  i += dim;
+	  continue;
+	}
+
+	if (kind == BLACKOUT_BIAS){
+	  part[p]->blackoutGrad.bias[row] += rows[i];
+	}
+	else {
+	  std::unordered_map<int, VecD>& grad = (kind == SOURCE_EMBED ? part[p]->sourceEmbed : kind == TARGET_EMBED ? part[p]->targetEmbed : part[p]->blackoutGrad.weight);
+	  auto found = grad.find(row);
+
+	  if (found == grad.end()){
+	    grad[row] = Eigen::Map<const VecD>(rows+i, dim);
+	  }
+	  else {
+	    found->second += Eigen::Map<const VecD>(rows+i, dim);
+	  }
+	}
+
+	i += dim;
+      }
+    }
+
+    res += rowNorm(*part[p]);
+  }
+
+  return res;
+}
+
+void EncDec::updatePart(EncDec::Grad& part, const Real learningRate){
+  if (this->optimizer.type == Optimizer::SGD){
+    for (auto it = part.sourceEmbed.begin(); it != part.sourceEmbed.end(); ++it){
+      this->sourceEmbed.col(it->first) -= learningRate*it->second;
+    }
+    for (auto it = part.targetEmbed.begin(); it != part.targetEmbed.end(); ++it){
+      this->targetEmbed.col(it->first) -= learningRate*it->second;
+    }
+
+    if (this->useBlackout){
+      this->blackout.sgd(part.blackoutGrad, learningRate);
+    }
+  }
+  else {
+    //the moments have been allocated, and only looked up here
+    Optimizer::Moment& sourceMom = this->optimizer.moment("sourceEmbed", this->sourceEmbed.rows(), this->sourceEmbed.cols());
+    Optimizer::Moment& targetMom = this->optimizer.moment("targetEmbed", this->targetEmbed.rows(), this->targetEmbed.cols());
+
+    for (auto it = part.sourceEmbed.begin(); it != part.sourceEmbed.end(); ++it){
+      this->optimizer.update(it->second, learningRate, sourceMom, this->sourceEmbed, it->first);
+    }
+    for (auto it = part.targetEmbed.begin(); it != part.targetEmbed.end(); ++it){
+      this->optimizer.update(it->second, learningRate, targetMom, this->targetEmbed, it->first);
+    }
+
+    if (this->useBlackout){
+      this->blackout.update(part.blackoutGrad, this->optimizer, learningRate);
+    }
+  }
+
+  part.initRows();
+}
+
+void EncDec::registerParams(EncDec::Grad& grad, const int numThreads){
+  grad.dense.clear();
+  grad.dense.numThreads = numThreads;
+
+  this->enc->registerParams(*grad.encGrad, "enc.", grad.dense);
+
+  if (this->bidirectional){
+    this->encRev->registerParams(*grad.encRevGrad, "encRev.", grad.dense);
+  }
+
+  if (this->useAttention){
+    grad.attnGrad.registerParams("attn.", this->attn, grad.dense);
+  }
+
+  this->dec->registerParams(*grad.decGrad, "dec.", grad.dense);
+
+  if (!this->useBlackout){
+    grad.softmaxGrad.registerParams("softmax.", this->softmax, grad.dense);
+  }
+}
+
+void EncDec::demo(const std::string& srcTrain, const std::string& tgtTrain, const std::string& srcDev, const std::string& tgtDev,
+		  const int rank, const int procNum, const std::string& ringName){
+  const int threSource = 1;
+  const int threTarget = 1;
+  Vocabulary sourceVoc(srcTrain, threSource);
+  Vocabulary targetVoc(tgtTrain, threTarget);
+  std::vector<EncDec::Data*> trainData, devData;
+  std::vector<std::string> tokens;
+
+  EncDec::loadData(srcTrain, tgtTrain, sourceVoc, targetVoc, trainData);
+  EncDec::loadData(srcDev, tgtDev, sourceVoc, targetVoc, devData);
 
   Real learningRate = 0.5;
   const int inputDim = 200;
   const int hiddenDim = 200;
-  const int miniBatchSize = 1;
+  const int miniBatchSize = 1*procNum; //each process takes its share of every mini batch
   const int numThread = 1;
   const bool useBlackout = true;
-  EncDec encdec(sourceVoc, targetVoc, trainData, devData, inputDim, hiddenDim, useBlackout);
+  const bool bidirectional = false;
+  const bool useAttention = false;
+  const EncDec::CELL cell = EncDec::LSTM_CELL;
+  const unsigned long encCacheSize = 64*1024*1024;
+  EncDec encdec(sourceVoc, targetVoc, trainData, devData, inputDim, hiddenDim, useBlackout, bidirectional, useAttention, cell);
   auto test = trainData[0]->src;
 
+  encdec.encCache = new EncoderCache(encCacheSize);
+
+  if (procNum > 1){
+    encdec.ring = new ShmRing(ringName, rank, procNum);
+    std::cout << "Data-parallel training: rank " << rank << " of " << procNum << " processes (" << ringName << ")" << std::endl;
+  }
+
   std::cout << "# of training data:    " << trainData.size() << std::endl;
   std::cout << "# of development data: " << devData.size() << std::endl;
   std::cout << "Source voc size: " << sourceVoc.tokenIndex.size() << std::endl;
@@ -608,6 +1456,12 @@ void EncDec::demo(const std::string& srcTrain, const std::string& tgtTrain, cons
     //encdec.save(oss.str());
   }
 
+  if (rank > 0){
+    return;
+  }
+
+  encdec.encCache->print();
+
   //intereactive translation
   std::cout << "Interactive translation" << std::endl;
 
@@ -632,31 +1486,381 @@ void EncDec::demo(const std::string& srcTrain, const std::string& tgtTrain, cons
     std::cout << "### Beam search ###" << std::endl;
     encdec.translate(tmp.src, 12, 100, 10);
   }
-  
-  return;
+}
 
-  encdec.load("model.1itr.bin");
+void EncDec::demoTranslation(const std::string& srcTrain, const std::string& tgtTrain, const std::string& modelFile, const std::string& inputFile, const std::string& outputFile, const int numThreads,
+			     const bool numa, const std::string& storage){
+  //these settings should be the same as those in EncDec::demo
+  const int threSource = 1;
+  const int threTarget = 1;
+  const int inputDim = 200;
+  const int hiddenDim = 200;
+  const bool useBlackout = true;
+  const bool bidirectional = false;
+  const bool useAttention = false;
+  const EncDec::CELL cell = EncDec::LSTM_CELL;
+  const int beam = 20;
+  const int maxLength = 100;
+  Vocabulary sourceVoc(srcTrain, threSource);
+  Vocabulary targetVoc(tgtTrain, threTarget);
+  std::vector<EncDec::Data*> trainData, devData;
+  const std::vector<int> masterCpu = Numa::affinity();
+
+  //with -numa, the model itself is the copy of node 0, and so is built there
+  if (numa){
+    Numa::pinToNode(0);
+  }
+
+  EncDec encdec(sourceVoc, targetVoc, trainData, devData, inputDim, hiddenDim, useBlackout, bidirectional, useAttention, cell);
+
+  if (!encdec.load(modelFile, storage)){
+    return;
+  }
+
+  std::cout << "Embeddings and output layer (" << storage << "): " << encdec.vocabBytes() << " bytes" << std::endl;
+
+  if (numa){
+    bool loaded = true;
+
+    encdec.pinThreads = true;
+    encdec.replica.assign(Numa::nodeNum(), 0);
+    encdec.replica[0] = &encdec;
+
+    //each copy is built (and so first touched) by a thread on its node
+#pragma omp parallel for num_threads(std::max((int)encdec.replica.size()-1, 1)) schedule(static, 1)
+    for (int node = 1; node < (int)encdec.replica.size(); ++node){
+      Numa::pinToNode(node);
+      encdec.replica[node] = new EncDec(sourceVoc, targetVoc, trainData, devData, inputDim, hiddenDim, useBlackout, bidirectional, useAttention, cell);
+
+      if (!encdec.replica[node]->load(modelFile, storage)){
+#pragma omp atomic write
+	loaded = false;
+      }
+    }
+
+    Numa::setAffinity(masterCpu);
+
+    if (!loaded){
+      std::cerr << "Failed to load the copies of the model on the NUMA nodes" << std::endl;
+      return;
+    }
+  }
+
+  encdec.translate(inputFile, outputFile, beam, maxLength, numThreads);
+}
 
+void EncDec::demoQuantization(const std::string& srcTrain, const std::string& tgtTrain, const std::string& srcDev, const std::string& tgtDev,
+			      const std::string& modelFile, const std::string& outputFile){
+  //these settings should be the same as those in EncDec::demo
+  const int threSource = 1;
+  const int threTarget = 1;
+  const int inputDim = 200;
+  const int hiddenDim = 200;
+  const bool useBlackout = true;
+  const bool bidirectional = false;
+  const bool useAttention = false;
+  const EncDec::CELL cell = EncDec::LSTM_CELL;
+  const int beam = 20;
+  const int maxLength = 100;
+  Vocabulary sourceVoc(srcTrain, threSource);
+  Vocabulary targetVoc(tgtTrain, threTarget);
+  std::vector<EncDec::Data*> trainData, devData;
+  EncDec encdec(sourceVoc, targetVoc, trainData, devData, inputDim, hiddenDim, useBlackout, bidirectional, useAttention, cell);
+  std::vector<std::vector<int> > output[2];
+  Real perp[2], bleu[2], elapsed[2];
+  unsigned long bytes[2];
+  int same = 0;
   struct timeval start, end;
-  
-  //translation
-  std::vector<std::vector<int> > output(encdec.devData.size());
-  gettimeofday(&start, 0);
-#pragma omp parallel for num_threads(numThread) schedule(dynamic) shared(output, encdec)
-  for (int i = 0; i < (int)encdec.devData.size(); ++i){
-    encdec.translate(output[i], encdec.devData[i]->src, 20, 100);
+
+  EncDec::loadData(srcDev, tgtDev, sourceVoc, targetVoc, devData);
+  encdec.load(modelFile);
+
+  for (int i = 0; i < 2; ++i){
+    if (i == 1 && !encdec.quantize()){
+      return;
+    }
+
+    gettimeofday(&start, 0);
+    perp[i] = encdec.evaluate(devData, beam, maxLength, output[i]);
+    gettimeofday(&end, 0);
+    elapsed[i] = (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06;
+    bleu[i] = EncDec::bleu(output[i], devData);
   }
 
-  gettimeofday(&end, 0);
-  std::cout << "Translation time: " << (end.tv_sec-start.tv_sec)/60.0 << " min." << std::endl;
- 
-  std::ofstream ofs("translation.txt");
-  
-  for (auto it = output.begin(); it != output.end(); ++it){
-    for (auto it2 = it->begin(); it2 != it->end(); ++it2){
-      ofs << encdec.targetVoc.tokenList[(*it2)]->str << " ";
+  encdec.save(outputFile);
+
+  for (int i = 0; i < 2; ++i){
+    std::ifstream ifs((i == 0 ? modelFile : outputFile).c_str(), std::ios::in|std::ios::binary|std::ios::ate);
+
+    bytes[i] = ifs.tellg();
+  }
+
+  for (int i = 0; i < (int)devData.size(); ++i){
+    same += (output[0][i] == output[1][i] ? 1 : 0);
+  }
+
+  std::cout << "Quantized " << modelFile << " into " << outputFile << " (int8 kernel: " << QuantMat::kernel() << ")" << std::endl;
+  std::cout << "Model bytes:             " << bytes[0] << " -> " << bytes[1] << " (x" << (Real)bytes[0]/bytes[1] << ")" << std::endl;
+  std::cout << "Dev perplexity:          " << perp[0] << " -> " << perp[1] << " (delta " << perp[1]-perp[0] << ")" << std::endl;
+  std::cout << "Dev BLEU:                " << bleu[0] << " -> " << bleu[1] << " (delta " << bleu[1]-bleu[0] << ")" << std::endl;
+  std::cout << "Identical translations:  " << same << " / " << devData.size() << std::endl;
+  std::cout << "Dev time (sec.):         " << elapsed[0] << " -> " << elapsed[1] << std::endl;
+
+  for (auto it = devData.begin(); it != devData.end(); ++it){
+    delete *it;
+  }
+}
+
+bool EncDec::quantize(){
+  if (this->cell != EncDec::LSTM_CELL){
+    std::cerr << "Quantization is supported for LSTM_CELL only" << std::endl;
+    return false;
+  }
+
+  if (this->quantized){
+    return true;
+  }
+
+  if (this->halved){
+    std::cerr << "The embeddings and the output layer are already stored in 16 bits" << std::endl;
+    return false;
+  }
+
+  RNN* enc = new QuantLSTM(*(LSTM*)this->enc);
+  RNN* dec = new QuantLSTM(*(LSTM*)this->dec);
+
+  delete this->enc;
+  delete this->dec;
+  this->enc = enc;
+  this->dec = dec;
+
+  if (this->bidirectional){
+    RNN* encRev = new QuantLSTM(*(LSTM*)this->encRev);
+
+    delete this->encRev;
+    this->encRev = encRev;
+  }
+
+  this->sourceEmbedQ.quantizeCols(this->sourceEmbed);
+  this->targetEmbedQ.quantizeCols(this->targetEmbed);
+  this->sourceEmbed.resize(0, 0);
+  this->targetEmbed.resize(0, 0);
+
+  if (this->useBlackout){
+    this->outputQ.quantizeCols(this->blackout.weight);
+    this->blackout.weight.resize(0, 0);
+  }
+  else {
+    this->outputQ.quantizeCols(this->softmax.weight);
+    this->softmax.weight.resize(0, 0);
+  }
+
+  if (this->encCache != 0){
+    this->encCache->clear();
+  }
+
+  this->quantized = true;
+  return true;
+}
+
+bool EncDec::load(const std::string& fileName, const std::string& storage){
+  if (storage == "int8"){
+    if (!this->quantize()){
+      return false;
     }
-    ofs << std::endl;
+
+    this->load(fileName);
+    return true;
+  }
+
+  if (storage != "double" && storage != "bf16" && storage != "fp16"){
+    std::cerr << "Unknown storage: " << storage << std::endl;
+    return false;
+  }
+
+  if (storage == "double"){
+    this->load(fileName);
+    return true;
+  }
+
+  const HalfMat::FORMAT format = (storage == "bf16" ? HalfMat::BF16 : HalfMat::FP16);
+  MatD& output = (this->useBlackout ? this->blackout.weight : this->softmax.weight);
+
+  if (this->quantized){
+    std::cerr << "The embeddings and the output layer are already quantized" << std::endl;
+    return false;
+  }
+
+  if (this->halved && this->sourceEmbedH.format != format){
+    std::cerr << "The embeddings and the output layer are already stored in the other 16-bit format" << std::endl;
+    return false;
+  }
+
+  //the double matrices are released before reading, and load compresses them column by column from the file,
+  //so that the double embeddings and output layer are never kept with the 16-bit ones
+  if (!this->halved){
+    this->sourceEmbedH.init(this->sourceEmbed.cols(), this->sourceEmbed.rows(), format);
+    this->targetEmbedH.init(this->targetEmbed.cols(), this->targetEmbed.rows(), format);
+    this->outputH.init(output.cols(), output.rows(), format);
+    this->sourceEmbed.resize(0, 0);
+    this->targetEmbed.resize(0, 0);
+    output.resize(0, 0);
+    this->halved = true;
+  }
+
+  this->load(fileName);
+  return true;
+}
+
+unsigned long EncDec::vocabBytes(){
+  if (this->quantized){
+    return this->sourceEmbedQ.bytes()+this->targetEmbedQ.bytes()+this->outputQ.bytes();
+  }
+  else if (this->halved){
+    return this->sourceEmbedH.bytes()+this->targetEmbedH.bytes()+this->outputH.bytes();
+  }
+
+  return sizeof(Real)*(this->sourceEmbed.size()+this->targetEmbed.size()+(this->useBlackout ? this->blackout.weight.size() : this->softmax.weight.size()));
+}
+
+bool EncDec::storeHalf(const HalfMat::FORMAT format){
+  if (this->quantized){
+    std::cerr << "The embeddings and the output layer are already quantized" << std::endl;
+    return false;
+  }
+
+  if (this->halved){
+    return this->sourceEmbedH.format == format;
+  }
+
+  this->sourceEmbedH.compressCols(this->sourceEmbed, format);
+  this->targetEmbedH.compressCols(this->targetEmbed, format);
+  this->sourceEmbed.resize(0, 0);
+  this->targetEmbed.resize(0, 0);
+
+  if (this->useBlackout){
+    this->outputH.compressCols(this->blackout.weight, format);
+    this->blackout.weight.resize(0, 0);
+  }
+  else {
+    this->outputH.compressCols(this->softmax.weight, format);
+    this->softmax.weight.resize(0, 0);
+  }
+
+  if (this->encCache != 0){
+    this->encCache->clear();
+  }
+
+  this->halved = true;
+  return true;
+}
+
+Real EncDec::evaluate(const std::vector<EncDec::Data*>& data, const int beam, const int maxLength, std::vector<std::vector<int> >& output){
+  EncDec::Workspace ws;
+  std::vector<RNN::State*> encState, decState;
+  Real loss = 0.0, denom = 0.0;
+
+  output.resize(data.size());
+
+  for (int i = 0; i < (int)data.size(); ++i){
+    while ((int)encState.size() < this->encStateNum(data[i]->src.size())){
+      encState.push_back(this->enc->newState());
+    }
+    while (decState.size() < data[i]->tgt.size()){
+      decState.push_back(this->dec->newState());
+    }
+
+    loss += this->calcLoss(data[i], encState, decState);
+    denom += data[i]->tgt.size();
+    this->translate(output[i], data[i]->src, beam, maxLength, ws);
+  }
+
+  for (auto it = encState.begin(); it != encState.end(); ++it){
+    delete *it;
+  }
+  for (auto it = decState.begin(); it != decState.end(); ++it){
+    delete *it;
+  }
+
+  return exp(loss/denom);
+}
+
+Real EncDec::bleu(const std::vector<std::vector<int> >& output, const std::vector<EncDec::Data*>& data){
+  const int N = 4;
+  Real match[N] = {0.0}, total[N] = {0.0};
+  Real hypLen = 0.0, refLen = 0.0, res = 0.0;
+
+  for (int i = 0; i < (int)output.size(); ++i){
+    const std::vector<int>& hyp = output[i];
+    const std::vector<int> ref(data[i]->tgt.begin(), data[i]->tgt.end()-1);
+
+    hypLen += hyp.size();
+    refLen += ref.size();
+
+    for (int n = 1; n <= N; ++n){
+      std::map<std::vector<int>, int> count;
+
+      for (int j = 0; j+n <= (int)ref.size(); ++j){
+	++count[std::vector<int>(ref.begin()+j, ref.begin()+j+n)];
+      }
+
+      //clipped by the counts in the reference
+      for (int j = 0; j+n <= (int)hyp.size(); ++j){
+	auto it = count.find(std::vector<int>(hyp.begin()+j, hyp.begin()+j+n));
+
+	if (it != count.end() && it->second > 0){
+	  --it->second;
+	  match[n-1] += 1.0;
+	}
+
+	total[n-1] += 1.0;
+      }
+    }
+  }
+
+  for (int n = 0; n < N; ++n){
+    if (match[n] == 0.0){
+      return 0.0;
+    }
+
+    res += log(match[n]/total[n])/N;
+  }
+
+  //brevity penalty
+  if (hypLen < refLen){
+    res += 1.0-refLen/hypLen;
+  }
+
+  return 100.0*exp(res);
+}
+
+void EncDec::loadData(const std::string& srcFile, const std::string& tgtFile, Vocabulary& sourceVoc, Vocabulary& targetVoc, std::vector<EncDec::Data*>& data){
+  std::ifstream ifsSrc(srcFile.c_str());
+  std::ifstream ifsTgt(tgtFile.c_str());
+  std::vector<std::string> tokens;
+  int numLine = 0;
+
+  for (std::string line; std::getline(ifsSrc, line); ){
+    data.push_back(new EncDec::Data);
+    Utils::split(line, tokens);
+
+    for (auto it = tokens.begin(); it != tokens.end(); ++it){
+      data.back()->src.push_back(sourceVoc.tokenIndex.count(*it) ? sourceVoc.tokenIndex.at(*it) : sourceVoc.unkIndex);
+    }
+
+    //std::reverse(data.back()->src.begin(), data.back()->src.end());
+    data.back()->src.push_back(sourceVoc.eosIndex);
+  }
+
+  for (std::string line; std::getline(ifsTgt, line); ){
+    Utils::split(line, tokens);
+
+    for (auto it = tokens.begin(); it != tokens.end(); ++it){
+      data[numLine]->tgt.push_back(targetVoc.tokenIndex.count(*it) ? targetVoc.tokenIndex.at(*it) : targetVoc.unkIndex);
+    }
+
+    data[numLine]->tgt.push_back(targetVoc.eosIndex);
+    ++numLine;
   }
 }
 
@@ -665,11 +1869,38 @@ void EncDec::save(const std::string& fileName){
 
   assert(ofs);
 
-  this->enc.save(ofs);
-  this->dec.save(ofs);
-  Utils::save(ofs, sourceEmbed);
-  Utils::save(ofs, targetEmbed);
+  this->enc->save(ofs);
 
+  if (this->bidirectional){
+    this->encRev->save(ofs);
+  }
+
+  this->dec->save(ofs);
+
+  if (this->useAttention){
+    this->attn.save(ofs);
+  }
+
+  if (this->quantized){
+    this->sourceEmbedQ.save(ofs);
+    this->targetEmbedQ.save(ofs);
+    this->outputQ.save(ofs);
+  }
+  else if (this->halved){
+    this->sourceEmbedH.saveCols(ofs);
+    this->targetEmbedH.saveCols(ofs);
+  }
+  else {
+    Utils::save(ofs, sourceEmbed);
+    Utils::save(ofs, targetEmbed);
+  }
+
+  //the same records as a double model, so that a halved model is loaded with any storage
+  if (this->halved){
+    this->outputH.saveCols(ofs);
+  }
+
+  //the weight is empty when quantized or halved
   if (this->useBlackout){
     this->blackout.save(ofs);
   }
@@ -683,10 +1914,39 @@ void EncDec::load(const std::string& fileName){
 
   assert(ifs);
 
-  this->enc.load(ifs);
-  this->dec.load(ifs);
-  Utils::load(ifs, sourceEmbed);
-  Utils::load(ifs, targetEmbed);
+  if (this->encCache != 0){
+    this->encCache->clear();
+  }
+
+  this->enc->load(ifs);
+
+  if (this->bidirectional){
+    this->encRev->load(ifs);
+  }
+
+  this->dec->load(ifs);
+
+  if (this->useAttention){
+    this->attn.load(ifs);
+  }
+
+  if (this->quantized){
+    this->sourceEmbedQ.load(ifs);
+    this->targetEmbedQ.load(ifs);
+    this->outputQ.load(ifs);
+  }
+  else if (this->halved){
+    this->sourceEmbedH.loadCols(ifs);
+    this->targetEmbedH.loadCols(ifs);
+  }
+  else {
+    Utils::load(ifs, sourceEmbed);
+    Utils::load(ifs, targetEmbed);
+  }
+
+  if (this->halved){
+    this->outputH.loadCols(ifs);
+  }
 
   if (this->useBlackout){
     this->blackout.load(ifs);
@@ -1,9 +1,17 @@
 #pragma once
 
-#include "LSTM.hpp"
+#include "RNN.hpp"
+#include "Affine.hpp"
 #include "Vocabulary.hpp"
 #include "SoftMax.hpp"
 #include "BlackOut.hpp"
+#include "EncoderCache.hpp"
+#include "BatchScheduler.hpp"
+#include "Optimizer.hpp"
+#include "ParamRegistry.hpp"
+#include "ShmRing.hpp"
+#include "QuantMat.hpp"
+#include "HalfMat.hpp"
 
 class EncDec{
 public:
@@ -11,39 +19,124 @@ public:
   class Grad;
   class DecCandidate;
   class ThreadArg;
+  class Workspace;
+
+  enum CELL{
+    LSTM_CELL,
+    LNLSTM_CELL,
+    GRU_CELL,
+    DEEPLSTM_CELL,
+  };
 
   EncDec(Vocabulary& sourceVoc_, Vocabulary& targetVoc_,
 	 std::vector<EncDec::Data*>& trainData_, std::vector<EncDec::Data*>& devData_,
 	 const int inputDim, const int hiddenDim,
-	 const bool useBlackout_);
+	 const bool useBlackout_, const bool bidirectional_ = false, const bool useAttention_ = false,
+	 const EncDec::CELL cell_ = EncDec::LSTM_CELL, const int depth = 2);
+  ~EncDec();
 
   bool useBlackout;
+  bool bidirectional; //encState[T+1], ..., encState[2T+1] hold the backward direction reading the source from its end
+  bool useAttention; //global attention over the encoder hidden states
+  EncDec::CELL cell; //recurrent unit of the encoder and the decoder (depth is used only for DEEPLSTM_CELL)
   Rand rnd;
   Vocabulary& sourceVoc;
   Vocabulary& targetVoc;
   std::vector<EncDec::Data*>& trainData;
   std::vector<EncDec::Data*>& devData;
-  LSTM enc, dec;
+  RNN* enc;
+  RNN* encRev; //0 unless bidirectional
+  RNN* dec;
   SoftMax softmax;
   BlackOut blackout;
+  Affine attn; //[h; context] -> attentional hidden state fed into the output layer
   MatD sourceEmbed;
   MatD targetEmbed;
   VecD zeros;
+  Real lengthPenalty; //for length normalization in beam search (<= 0: not used)
+  Real pruneRelative; //prune the hypotheses whose probability is less than pruneRelative*(the best one) (<= 0: not used)
+  Real pruneAbsolute; //prune the hypotheses whose log probability is less than (the best one)-pruneAbsolute (<= 0: not used)
+  int checkpoint; //keep h and c of every checkpoint-th state only and recompute the rest in backward (<= 1: not used; LSTM and LnLSTM only)
+  EncoderCache* encCache; //used only in translation; deleted with the model, as ring (0: not used)
+  Optimizer optimizer; //plain SGD by default; the adaptive ones (Adam, etc.) keep their moments here
+  bool asynchronous; //lock-free (Hogwild) training: each thread updates the shared parameters after each of its mini batches (SGD only)
+  int maxStaleness; //asynchronous only: skip the embedding rows updated more than maxStaleness times by the other threads since read (< 0: not bounded)
+  std::vector<unsigned int> sourceVersion, targetVersion; //# of asynchronous updates of each embedding row
+  ShmRing* ring; //data-parallel training by several processes, each of which takes its share of every mini batch (0: not used)
+  bool pinThreads; //pin the worker threads to cores spread over the NUMA nodes (see Numa); their buffers are then first touched on their own nodes
+  std::vector<EncDec*> replica; //per-node copies of the parameters, read by the pinned threads of each node in translation (empty: not used; may contain this)
+  bool quantized; //int8 inference (see quantize): the recurrent units are QuantLSTM, and the embeddings and the output layer are below
+  QuantMat sourceEmbedQ, targetEmbedQ, outputQ; //a row per word (outputQ: the weight of SoftMax or BlackOut, transposed)
+  bool halved; //the embeddings and the output layer are stored in 16 bits (see storeHalf)
+  HalfMat sourceEmbedH, targetEmbedH, outputH; //as sourceEmbedQ, targetEmbedQ and outputQ
 
-  std::vector<std::vector<LSTM::State*> > encStateDev, decStateDev;
+  std::vector<std::vector<RNN::State*> > encStateDev, decStateDev;
 
-  void encode(const std::vector<int>& src, std::vector<LSTM::State*>& encState);
+  int encStateNum(const int srcLen);
+  void encode(const std::vector<int>& src, std::vector<RNN::State*>& encState);
+  void encode(const std::vector<int>& src, std::vector<RNN::State*>& encState, MatD& encMem);
+  void initDecoder(const int srcLen, const std::vector<RNN::State*>& encState, RNN::State* decInit);
+  void encoderMemory(const int srcLen, const std::vector<RNN::State*>& encState, MatD& encMem);
+  void attend(const MatD& encMem, const MatD& hs, MatD& alpha, MatD& context, MatD& s);
+  void attendBackward(const MatD& encMem, const MatD& hs, const MatD& alpha, const MatD& context, const MatD& s, const MatD& dels, MatD& delhs, MatD& delEncMem, Affine::Grad& grad);
+  void decoderOutput(EncDec::Data* data, const std::vector<RNN::State*>& encState, const std::vector<RNN::State*>& decState, MatD& s);
+  void lookup(const MatD& embed, const std::vector<int>& index, const int length, MatD& xs);
+  void lookup(const QuantMat& embed, const std::vector<int>& index, const int length, MatD& xs);
+  void lookup(const HalfMat& embed, const std::vector<int>& index, const int length, MatD& xs);
+  //the source (or target) embeddings in the storage of the model (double, int8 or 16 bits)
+  void lookup(const bool source, const std::vector<int>& index, const int length, MatD& xs);
+  //the distribution over the target words by SoftMax, BlackOut, outputQ or outputH
+  void calcDist(const VecD& s, VecD& targetDist);
+  RNN* newRNN(const int inputDim, const int hiddenDim, const int depth);
+  Real lengthNorm(const int length);
+  void search(const std::vector<int>& src, const int beam, const int maxLength, EncDec::Workspace& ws, std::vector<EncDec::DecCandidate>& candidate);
   void translate(const std::vector<int>& src, const int beam = 1, const int maxLength = 100, const int showNum = 1);
   bool translate(std::vector<int>& output, const std::vector<int>& src, const int beam = 1, const int maxLength = 100);
-  Real calcLoss(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState);
-  Real calcPerplexity(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState);
-  void gradCheck(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState, EncDec::Grad& grad);
-  void gradCheck(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState, MatD& param, const MatD& grad);
-  void train(EncDec::Data* data, std::vector<LSTM::State*>& encState, std::vector<LSTM::State*>& decState, EncDec::Grad& grad, Real& loss);
+  bool translate(std::vector<int>& output, const std::vector<int>& src, const int beam, const int maxLength, EncDec::Workspace& ws);
+  void translate(const std::string& inputFile, const std::string& outputFile, const int beam, const int maxLength, const int numThreads = 1, const int tokenBudget = 256);
+  Real calcLoss(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState);
+  Real calcPerplexity(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState);
+  void gradCheck(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState, EncDec::Grad& grad);
+  void gradCheck(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState, MatD& param, const MatD& grad);
+  void train(EncDec::Data* data, std::vector<RNN::State*>& encState, std::vector<RNN::State*>& decState, EncDec::Grad& grad, Real& loss);
   void trainOpenMP(const Real learningRate, const int miniBatchSize = 1, const int numThreads = 1);
+  void trainAsync(const std::vector<std::pair<int, int> >& miniBatch, std::vector<EncDec::ThreadArg*>& args, const Real learningRate, const int miniBatchSize, const int numThreads);
+  //returns # of the rows skipped by maxStaleness
+  unsigned long updateRows(const std::unordered_map<int, VecD>& grad, const Real learningRate, MatD& embed,
+			   std::vector<unsigned int>& version, const std::unordered_map<int, unsigned int>& readVersion);
+  //the rows of the sparse gradients (the embeddings and BlackOut) are partitioned by (row % partNum) to be reduced and updated in parallel;
+  //reduceRows returns the squared norm of the partition
+  Real reduceRows(std::vector<EncDec::ThreadArg*>& args, const int p, const int partNum, EncDec::Grad& part);
+  void updatePart(EncDec::Grad& part, const Real learningRate);
+  //sums the partitions over the processes of the ring (through its row regions) and returns their squared norm
+  Real exchangeRows(std::vector<EncDec::Grad*>& part, const int numThreads);
+  unsigned long rowCapacity();
+  //the dense parameters and gradients (all but the embeddings and BlackOut) are processed via grad.dense once registered
+  void registerParams(EncDec::Grad& grad, const int numThreads = 1);
+  //post-training quantization for translation (LSTM_CELL only); the double parameters of the recurrent units, the embeddings
+  //and the output layer are replaced by the int8 ones, and a quantized model is saved and loaded as such (quantize before load)
+  bool quantize();
+  //keeps the embeddings and the weight of the output layer (the largest ones) in bf16 or fp16 for translation, and releases the double ones;
+  //a halved model is saved in the same format as a double one, and load after storeHalf reads a model file into 16 bits
+  bool storeHalf(const HalfMat::FORMAT format);
+  //global perplexity and the translations of data
+  Real evaluate(const std::vector<EncDec::Data*>& data, const int beam, const int maxLength, std::vector<std::vector<int> >& output);
   void save(const std::string& fileName);
   void load(const std::string& fileName);
-  static void demo(const std::string& srcTrain, const std::string& tgtTrain, const std::string& srcDev, const std::string& tgtDev);
+  //storage: "double", "int8" (a model saved after quantize), or "bf16" and "fp16" (a double one read into 16 bits, as storeHalf)
+  bool load(const std::string& fileName, const std::string& storage);
+  //bytes of the embeddings and the weight of the output layer in the current storage
+  unsigned long vocabBytes();
+  static void loadData(const std::string& srcFile, const std::string& tgtFile, Vocabulary& sourceVoc, Vocabulary& targetVoc, std::vector<EncDec::Data*>& data);
+  //corpus BLEU-4 (%) against the targets of data (without EOS)
+  static Real bleu(const std::vector<std::vector<int> >& output, const std::vector<EncDec::Data*>& data);
+  static void demo(const std::string& srcTrain, const std::string& tgtTrain, const std::string& srcDev, const std::string& tgtDev,
+		   const int rank = 0, const int procNum = 1, const std::string& ringName = "");
+  static void demoTranslation(const std::string& srcTrain, const std::string& tgtTrain, const std::string& modelFile, const std::string& inputFile, const std::string& outputFile, const int numThreads = 1,
+			      const bool numa = false, const std::string& storage = "double");
+  //quantizes the model and reports the perplexity and BLEU on the development data against the double one
+  static void demoQuantization(const std::string& srcTrain, const std::string& tgtTrain, const std::string& srcDev, const std::string& tgtDev,
+			       const std::string& modelFile, const std::string& outputFile);
 };
 
 class EncDec::Data{
@@ -53,24 +146,60 @@ public:
 
 class EncDec::Grad{
 public:
+  Grad(): encGrad(0), encRevGrad(0), decGrad(0), activationBytes(0) {}
+  ~Grad(){
+    delete this->encGrad;
+    delete this->encRevGrad;
+    delete this->decGrad;
+  }
+
   std::unordered_map<int, VecD> sourceEmbed, targetEmbed;
-  LSTM::Grad lstmSrcGrad;
-  LSTM::Grad lstmTgtGrad;
+  RNN::Grad* encGrad;
+  RNN::Grad* encRevGrad;
+  RNN::Grad* decGrad;
   SoftMax::Grad softmaxGrad;
   BlackOut::Grad blackoutGrad;
   BlackOut::State blackoutState;
+  Affine::Grad attnGrad;
+  ParamRegistry dense; //empty unless registered (see EncDec::registerParams)
+  unsigned long activationBytes; //max # of bytes of the states kept from forward to backward, and recomputed in backward
 
-  void init(){
+  void initRows(){
     this->sourceEmbed.clear();
     this->targetEmbed.clear();
-    this->lstmSrcGrad.init();
-    this->lstmTgtGrad.init();
-    this->softmaxGrad.init();
     this->blackoutGrad.init();
   }
 
+  void init(){
+    this->initRows();
+
+    if (this->dense.size > 0){
+      this->dense.zero();
+      return;
+    }
+
+    this->encGrad->init();
+    this->decGrad->init();
+    if (this->encRevGrad != 0){
+      this->encRevGrad->init();
+    }
+    this->softmaxGrad.init();
+    this->attnGrad.init();
+  }
+
   Real norm(){
-    Real res = this->lstmSrcGrad.norm()+this->lstmTgtGrad.norm()+this->softmaxGrad.norm()+this->blackoutGrad.norm();
+    Real res = this->blackoutGrad.norm();
+
+    if (this->dense.size > 0){
+      res += this->dense.squaredNorm();
+    }
+    else {
+      res += this->encGrad->norm()+this->decGrad->norm()+this->softmaxGrad.norm()+this->attnGrad.norm();
+
+      if (this->encRevGrad != 0){
+	res += this->encRevGrad->norm();
+      }
+    }
 
     for (auto it = this->sourceEmbed.begin(); it != this->sourceEmbed.end(); ++it){
       res += it->second.squaredNorm();
@@ -81,51 +210,36 @@ public:
 
     return res;
   }
-
-  void operator += (const EncDec::Grad& grad){
-    this->lstmSrcGrad += grad.lstmSrcGrad;
-    this->lstmTgtGrad += grad.lstmTgtGrad;
-    this->softmaxGrad += grad.softmaxGrad;
-    this->blackoutGrad += grad.blackoutGrad;
-
-    for (auto it = grad.sourceEmbed.begin(); it != grad.sourceEmbed.end(); ++it){
-      if (this->sourceEmbed.count(it->first)){
-	this->sourceEmbed.at(it->first) += it->second;
-      }
-      else {
-	this->sourceEmbed[it->first] = it->second;
-      }
-    }
-    for (auto it = grad.targetEmbed.begin(); it != grad.targetEmbed.end(); ++it){
-      if (this->targetEmbed.count(it->first)){
-	this->targetEmbed.at(it->first) += it->second;
-      }
-      else {
-	this->targetEmbed[it->first] = it->second;
-      }
-    }
-  }
 };
 
 class EncDec::DecCandidate{
 public:
   DecCandidate():
-    score(0.0), stop(false)
+    score(0.0), normScore(0.0), stop(false)
   {}
 
   Real score;
+  Real normScore; //score with length normalization
   std::vector<int> tgt;
-  std::vector<LSTM::State*> decState;
+  std::vector<RNN::State*> decState;
   bool stop;
 };
 
 class EncDec::ThreadArg{
 public:
   ThreadArg(EncDec& encdec_):
-    encdec(encdec_), loss(0.0)
+    encdec(encdec_), loss(0.0), staleRows(0)
   {
-    this->grad.lstmSrcGrad = LSTM::Grad(this->encdec.enc);
-    this->grad.lstmTgtGrad = LSTM::Grad(this->encdec.dec);
+    this->grad.encGrad = this->encdec.enc->newGrad();
+    this->grad.decGrad = this->encdec.dec->newGrad();
+
+    if (this->encdec.bidirectional){
+      this->grad.encRevGrad = this->encdec.encRev->newGrad();
+    }
+
+    if (this->encdec.useAttention){
+      this->grad.attnGrad = Affine::Grad(this->encdec.attn);
+    }
 
     if (this->encdec.useBlackout){
       this->grad.blackoutState = BlackOut::State(this->encdec.blackout);
@@ -140,5 +254,41 @@ public:
   EncDec& encdec;
   EncDec::Grad grad;
   Real loss;
-  std::vector<LSTM::State*> encState, decState;
+  std::vector<RNN::State*> encState, decState;
+  std::unordered_map<int, unsigned int> sourceVersion, targetVersion; //versions of the embedding rows when read (asynchronous training)
+  unsigned long staleRows;
+};
+
+class EncDec::Workspace{
+public:
+  Workspace(): used(0) {};
+  ~Workspace(){
+    for (auto it = this->encState.begin(); it != this->encState.end(); ++it){
+      delete *it;
+    }
+    for (auto it = this->decState.begin(); it != this->decState.end(); ++it){
+      delete *it;
+    }
+  };
+
+  std::vector<RNN::State*> encState;
+  std::vector<RNN::State*> decState; //pool shared by all the beam candidates
+  MatD encMem; //encoder hidden states (H x T), shared by all the beam candidates
+  int used;
+
+  void reset(const RNN& enc, const int numState){
+    while ((int)this->encState.size() < numState){
+      this->encState.push_back(enc.newState());
+    }
+
+    this->used = 0;
+  }
+
+  RNN::State* next(const RNN& dec){
+    if (this->used == (int)this->decState.size()){
+      this->decState.push_back(dec.newState());
+    }
+
+    return this->decState[this->used++];
+  }
 };
@@ -0,0 +1,107 @@
+#include "EncoderCache.hpp"
+#include <iostream>
+
+EncoderCache::EncoderCache(const unsigned long maxBytes_):
+  maxBytes(maxBytes_), bytes(0),
+  hitCount(0), missCount(0), evictCount(0)
+{}
+
+EncoderCache::~EncoderCache(){
+  this->clear();
+}
+
+bool EncoderCache::get(const std::vector<int>& src, const RNN& rnn, std::vector<RNN::State*>& encState){
+  bool hit = false;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    auto it = this->index.find(src);
+
+    if (it == this->index.end()){
+      ++this->missCount;
+    }
+    else {
+      EncoderCache::Entry* entry = *(it->second);
+
+      for (int i = 0; i < entry->state.cols(); ++i){
+	rnn.setState(entry->state.col(i), encState[i]);
+      }
+
+      this->lru.splice(this->lru.begin(), this->lru, it->second);
+      ++this->hitCount;
+      hit = true;
+    }
+  }
+
+  return hit;
+}
+
+void EncoderCache::put(const std::vector<int>& src, const RNN& rnn, const std::vector<RNN::State*>& encState, const int numState){
+  EncoderCache::Entry* entry = new EncoderCache::Entry;
+  VecD v;
+
+  entry->src = src;
+  entry->state = MatD(rnn.stateDim(), numState);
+
+  for (int i = 0; i < numState; ++i){
+    rnn.getState(encState[i], v);
+    entry->state.col(i) = v;
+  }
+
+  if (entry->size() > this->maxBytes){
+    delete entry;
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    if (this->index.count(src)){
+      delete entry;
+    }
+    else {
+      this->bytes += entry->size();
+      this->lru.push_front(entry);
+      this->index[src] = this->lru.begin();
+
+      while (this->bytes > this->maxBytes){
+	EncoderCache::Entry* last = this->lru.back();
+
+	this->bytes -= last->size();
+	this->index.erase(last->src);
+	this->lru.pop_back();
+	delete last;
+	++this->evictCount;
+      }
+    }
+  }
+}
+
+void EncoderCache::clear(){
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    for (auto it = this->lru.begin(); it != this->lru.end(); ++it){
+      delete *it;
+    }
+
+    this->lru.clear();
+    this->index.clear();
+    this->bytes = 0;
+  }
+}
+
+Real EncoderCache::hitRate(){
+  const unsigned long total = this->hitCount+this->missCount;
+
+  return total == 0 ? 0.0 : (Real)this->hitCount/total;
+}
+
+void EncoderCache::print(){
+  std::cout << "Encoder cache: "
+	    << this->hitCount << " hits, "
+	    << this->missCount << " misses, "
+	    << this->evictCount << " evictions (hit rate: " << this->hitRate() << "), "
+	    << this->lru.size() << " entries in " << this->bytes/1024 << "/" << this->maxBytes/1024 << " KB" << std::endl;
+}
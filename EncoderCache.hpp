@@ -0,0 +1,51 @@
+#pragma once
+
+#include "RNN.hpp"
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+class EncoderCache{
+public:
+  EncoderCache(const unsigned long maxBytes_);
+  ~EncoderCache();
+
+  class Entry;
+  class Hash{
+  public:
+    size_t operator()(const std::vector<int>& src) const {
+      size_t seed = src.size();
+
+      for (auto it = src.begin(); it != src.end(); ++it){
+	seed ^= (size_t)(*it)+0x9e3779b9+(seed << 6)+(seed >> 2);
+      }
+
+      return seed;
+    }
+  };
+
+  unsigned long maxBytes; //memory bound for the cached states
+  unsigned long bytes;
+  unsigned long hitCount, missCount, evictCount;
+
+  std::list<EncoderCache::Entry*> lru; //the most recently used entry comes first
+  std::unordered_map<std::vector<int>, std::list<EncoderCache::Entry*>::iterator, EncoderCache::Hash> index;
+  std::mutex mtx; //shared by the OpenMP threads of translate and the worker threads of TranslationServer
+
+  bool get(const std::vector<int>& src, const RNN& rnn, std::vector<RNN::State*>& encState);
+  void put(const std::vector<int>& src, const RNN& rnn, const std::vector<RNN::State*>& encState, const int numState);
+  void clear();
+  Real hitRate();
+  void print();
+};
+
+class EncoderCache::Entry{
+public:
+  std::vector<int> src;
+  MatD state; //the i-th column is the recurrent state of encState[i]
+
+  unsigned long size(){
+    return sizeof(EncoderCache::Entry)+2*this->src.size()*sizeof(int)+this->state.size()*sizeof(Real);
+  }
+};
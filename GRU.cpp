@@ -1,6 +1,7 @@
 #include "GRU.hpp"
 #include "ActFunc.hpp"
 #include "Utils.hpp"
+#include "ParamRegistry.hpp"
 #include <Eigen/SVD>
 
 GRU::GRU(const int inputDim, const int hiddenDim){
@@ -105,6 +106,70 @@ void GRU::load(std::ifstream& ifs){
   Utils::load(ifs, this->Wxu); Utils::load(ifs, this->Whu); Utils::load(ifs, this->bu);
 }
 
+RNN::State* GRU::newState() const {
+  return new GRU::State;
+}
+
+RNN::Grad* GRU::newGrad() const {
+  return new GRU::Grad(*this);
+}
+
+int GRU::stateDim() const {
+  return this->br.rows();
+}
+
+void GRU::getState(const RNN::State* s, VecD& v) const {
+  v = s->h;
+}
+
+void GRU::setState(const VecD& v, RNN::State* s) const {
+  s->h = v;
+}
+
+void GRU::getStateGrad(const RNN::State* s, VecD& v) const {
+  v = s->delh;
+}
+
+void GRU::setStateGrad(const VecD& v, RNN::State* s) const {
+  s->delh += v;
+}
+
+void GRU::forward(const VecD& xt, const RNN::State* prev, RNN::State* cur){
+  this->forward(xt, (const GRU::State*)prev, (GRU::State*)cur);
+}
+
+void GRU::forwardSeq(const MatD& xs, std::vector<RNN::State*>& state){
+  for (int t = 0; t < xs.cols(); ++t){
+    this->forward(xs.col(t), (const GRU::State*)state[t], (GRU::State*)state[t+1]);
+  }
+}
+
+void GRU::backwardSeq(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad){
+  for (int t = xs.cols(); t >= 1; --t){
+    this->backward((GRU::State*)state[t-1], (GRU::State*)state[t], (GRU::Grad&)grad, xs.col(t-1));
+  }
+}
+
+void GRU::sgd(const RNN::Grad& grad, const Real learningRate){
+  this->sgd((const GRU::Grad&)grad, learningRate);
+}
+
+void GRU::registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg){
+  GRU::Grad& g = (GRU::Grad&)grad;
+
+  reg.add(prefix+"Wxr", this->Wxr, g.Wxr);
+  reg.add(prefix+"Whr", this->Whr, g.Whr);
+  reg.add(prefix+"br", this->br, g.br);
+
+  reg.add(prefix+"Wxz", this->Wxz, g.Wxz);
+  reg.add(prefix+"Whz", this->Whz, g.Whz);
+  reg.add(prefix+"bz", this->bz, g.bz);
+
+  reg.add(prefix+"Wxu", this->Wxu, g.Wxu);
+  reg.add(prefix+"Whu", this->Whu, g.Whu);
+  reg.add(prefix+"bu", this->bu, g.bu);
+}
+
 void GRU::State::clear(){
   this->h = VecD();
   this->u = VecD();
@@ -115,6 +180,11 @@ void GRU::State::clear(){
   this->delx = VecD();
 }
 
+unsigned long GRU::State::bytes(){
+  return sizeof(Real)*(this->h.size()+this->u.size()+this->r.size()+this->z.size()+this->rh.size()+
+		       this->delh.size()+this->delx.size());
+}
+
 GRU::Grad::Grad(const GRU& gru){
   this->Wxr = MatD::Zero(gru.Wxr.rows(), gru.Wxr.cols());
   this->Whr = MatD::Zero(gru.Whr.rows(), gru.Whr.cols());
@@ -147,3 +217,4 @@ void GRU::Grad::operator += (const GRU::Grad& grad){
   this->Wxz += grad.Wxz; this->Whz += grad.Whz; this->bz += grad.bz;
   this->Wxu += grad.Wxu; this->Whu += grad.Whu; this->bu += grad.bu;
 }
+
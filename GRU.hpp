@@ -1,10 +1,11 @@
 #pragma once
 
+#include "RNN.hpp"
 #include "Matrix.hpp"
 #include "Rand.hpp"
 #include <fstream>
 
-class GRU{
+class GRU : public RNN{
 public:
   GRU(){};
   GRU(const int inputDim, const int hiddenDim);
@@ -22,19 +23,34 @@ public:
   void sgd(const GRU::Grad& grad, const Real learningRate);
   void save(std::ofstream& ofs);
   void load(std::ifstream& ifs);
+
+  //RNN interface (the recurrent state is h)
+  RNN::State* newState() const;
+  RNN::Grad* newGrad() const;
+  int stateDim() const;
+  void getState(const RNN::State* s, VecD& v) const;
+  void setState(const VecD& v, RNN::State* s) const;
+  void getStateGrad(const RNN::State* s, VecD& v) const;
+  void setStateGrad(const VecD& v, RNN::State* s) const;
+  void forward(const VecD& xt, const RNN::State* prev, RNN::State* cur);
+  void forwardSeq(const MatD& xs, std::vector<RNN::State*>& state);
+  void backwardSeq(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad);
+  void sgd(const RNN::Grad& grad, const Real learningRate);
+  void registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg);
 };
 
-class GRU::State{
+class GRU::State: public RNN::State{
 public:
-  VecD h, u, r, z;
-  VecD rh;
+  ~State() {this->clear();};
 
-  VecD delh, delx; //for backprop
+  VecD u, r, z;
+  VecD rh;
 
   void clear();
+  unsigned long bytes();
 };
 
-class GRU::Grad{
+class GRU::Grad: public RNN::Grad{
 public:
   Grad(){}
   Grad(const GRU& gru);
@@ -0,0 +1,186 @@
+#include "HalfMat.hpp"
+#include "Utils.hpp"
+#include <cmath>
+#include <cstring>
+#if defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+#include <immintrin.h>
+#define N3LP_HALF_SIMD
+#endif
+
+static unsigned int floatBits(const float x){
+  unsigned int u;
+
+  memcpy(&u, &x, sizeof(u));
+  return u;
+}
+
+static float bitsFloat(const unsigned int u){
+  float x;
+
+  memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+unsigned short HalfMat::fromFloat(const float x, const HalfMat::FORMAT format){
+  const unsigned int u = floatBits(x);
+
+  if (format == HalfMat::BF16){
+    if ((u & 0x7fffffff) > 0x7f800000){
+      return (unsigned short)((u >> 16) | 0x40); //quiet NaN
+    }
+
+    return (unsigned short)((u+0x7fff+((u >> 16) & 1)) >> 16);
+  }
+
+#if defined(N3LP_HALF_SIMD)
+  return _cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT);
+#else
+  const unsigned short sign = (u >> 16) & 0x8000;
+  const unsigned int abs = u & 0x7fffffff;
+
+  if (abs >= 0x7f800000){
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0); //Inf or NaN
+  }
+  if (abs >= 0x477ff000){
+    return sign | 0x7c00; //rounded to Inf
+  }
+  if (abs < 0x38800000){
+    return sign | (unsigned short)lrintf(bitsFloat(abs)*16777216.0f); //subnormal (2^24 = 1/the smallest one)
+  }
+
+  const unsigned int rem = abs & 0x1fff;
+  unsigned short h = (unsigned short)((((abs >> 23)-112) << 10) | ((abs >> 13) & 0x3ff));
+
+  //a carry goes to the exponent
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))){
+    ++h;
+  }
+
+  return sign | h;
+#endif
+}
+
+float HalfMat::toFloat(const unsigned short h, const HalfMat::FORMAT format){
+  if (format == HalfMat::BF16){
+    return bitsFloat((unsigned int)h << 16);
+  }
+
+#if defined(N3LP_HALF_SIMD)
+  return _cvtsh_ss(h);
+#else
+  const unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+  const unsigned int exp = (h >> 10) & 0x1f;
+  const unsigned int mant = h & 0x3ff;
+
+  if (exp == 0){
+    return (sign ? -1.0f : 1.0f)*ldexpf((float)mant, -24);
+  }
+  if (exp == 0x1f){
+    return bitsFloat(sign | 0x7f800000 | (mant << 13));
+  }
+
+  return bitsFloat(sign | ((exp+112) << 23) | (mant << 13));
+#endif
+}
+
+void HalfMat::compressCols(const MatD& m, const HalfMat::FORMAT format_){
+  this->format = format_;
+  this->rows = m.cols();
+  this->cols = m.rows();
+  this->data.resize((unsigned long)this->rows*this->cols);
+
+  for (unsigned long i = 0; i < this->data.size(); ++i){
+    this->data[i] = HalfMat::fromFloat((float)m.data()[i], this->format);
+  }
+}
+
+void HalfMat::init(const int rows_, const int cols_, const HalfMat::FORMAT format_){
+  this->format = format_;
+  this->rows = rows_;
+  this->cols = cols_;
+  this->data.clear();
+}
+
+void HalfMat::gemv(const VecD& x, VecD& y) const {
+  std::vector<float> xf(this->cols);
+
+  for (int j = 0; j < this->cols; ++j){
+    xf[j] = (float)x.coeff(j, 0);
+  }
+
+  for (int i = 0; i < this->rows; ++i){
+    const unsigned short* h = &this->data[(unsigned long)i*this->cols];
+    float res = 0.0f;
+    int j = 0;
+
+#if defined(N3LP_HALF_SIMD)
+    __m256 acc = _mm256_setzero_ps();
+
+    for (; j+8 <= this->cols; j += 8){
+      const __m128i v = _mm_loadu_si128((const __m128i*)(h+j));
+      const __m256 w = (this->format == HalfMat::BF16 ?
+			_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(v), 16)) :
+			_mm256_cvtph_ps(v));
+
+      acc = _mm256_fmadd_ps(w, _mm256_loadu_ps(&xf[j]), acc);
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x1));
+    res = _mm_cvtss_f32(sum);
+#endif
+
+    for (; j < this->cols; ++j){
+      res += HalfMat::toFloat(h[j], this->format)*xf[j];
+    }
+
+    y.coeffRef(i, 0) += res;
+  }
+}
+
+void HalfMat::row(const int i, Real* v) const {
+  const unsigned short* h = &this->data[(unsigned long)i*this->cols];
+
+  for (int j = 0; j < this->cols; ++j){
+    v[j] = HalfMat::toFloat(h[j], this->format);
+  }
+}
+
+unsigned long HalfMat::bytes() const {
+  return sizeof(unsigned short)*this->data.size();
+}
+
+void HalfMat::saveCols(std::ofstream& ofs) const {
+  VecD v(this->cols);
+
+  for (int i = 0; i < this->rows; ++i){
+    this->row(i, v.data());
+    Utils::save(ofs, v);
+  }
+}
+
+void HalfMat::loadCols(std::ifstream& ifs){
+  VecD v(this->cols);
+
+  this->data.resize((unsigned long)this->rows*this->cols);
+
+  for (int i = 0; i < this->rows; ++i){
+    unsigned short* h = &this->data[(unsigned long)i*this->cols];
+
+    Utils::load(ifs, v);
+
+    for (int j = 0; j < this->cols; ++j){
+      h[j] = HalfMat::fromFloat((float)v.coeff(j, 0), this->format);
+    }
+  }
+}
+
+const char* HalfMat::kernel(){
+#if defined(N3LP_HALF_SIMD)
+  return "f16c";
+#else
+  return "scalar";
+#endif
+}
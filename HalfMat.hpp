@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Matrix.hpp"
+#include <vector>
+#include <fstream>
+
+//matrix with a row per word stored in 16 bits (bf16 or fp16) for the inference (see EncDec::storeHalf); the values are converted
+//to float on the fly, only for the rows looked up (embeddings) or inside the dot products (output layer)
+class HalfMat{
+public:
+  enum FORMAT{
+    BF16, //the upper half of float: the same range, 8 bits of precision
+    FP16, //IEEE half: 11 bits of precision, but |x| < 65520
+  };
+
+  HalfMat(): format(HalfMat::BF16), rows(0), cols(0) {};
+
+  HalfMat::FORMAT format;
+  int rows, cols;
+  std::vector<unsigned short> data; //rows x cols
+
+  //stores each column of m (e.g., the embeddings and the weight of the output layer)
+  void compressCols(const MatD& m, const HalfMat::FORMAT format_);
+  //an empty matrix of the shape to be read by loadCols
+  void init(const int rows_, const int cols_, const HalfMat::FORMAT format_);
+  //y += W*x
+  void gemv(const VecD& x, VecD& y) const;
+  //the i-th row (cols values)
+  void row(const int i, Real* v) const;
+  unsigned long bytes() const;
+  //the matrix is saved as the columns of a double one (as Utils::save of the original matrix), and read back column by column
+  //with rows, cols and format set beforehand
+  void saveCols(std::ofstream& ofs) const;
+  void loadCols(std::ifstream& ifs);
+
+  //round to nearest even
+  static unsigned short fromFloat(const float x, const HalfMat::FORMAT format);
+  static float toFloat(const unsigned short h, const HalfMat::FORMAT format);
+  //the conversion kernel selected at compile time (e.g., "f16c")
+  static const char* kernel();
+};
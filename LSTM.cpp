@@ -2,6 +2,7 @@
 #include "ActFunc.hpp"
 #include "Utils.hpp"
 #include "Optimizer.hpp"
+#include "ParamRegistry.hpp"
 
 LSTM::LSTM(const int inputDim, const int hiddenDim):
   dropoutRateX(-1.0), dropoutRateA(-1.0), dropoutRateH(-1.0)
@@ -449,6 +450,336 @@ void LSTM::backward(LSTM::State* cur, LSTM::Grad& grad, const VecD& xt, const Ve
   grad.bu += delu;
 }
 
+//[Wxi; Wxf; Wxo; Wxu]*xs, computed for all the time steps before the recurrence
+void LSTM::projectInput(const MatD& xs, MatD& xProj){
+  const int H = this->bi.rows();
+
+  xProj.resize(4*H, xs.cols());
+  xProj.middleRows(0*H, H).noalias() = this->Wxi*xs;
+  xProj.middleRows(1*H, H).noalias() = this->Wxf*xs;
+  xProj.middleRows(2*H, H).noalias() = this->Wxo*xs;
+  xProj.middleRows(3*H, H).noalias() = this->Wxu*xs;
+}
+
+void LSTM::forward(const MatD& xProj, const int t, const LSTM::State* prev, LSTM::State* cur){
+  const int H = this->bi.rows();
+
+  cur->i = this->bi+xProj.block(0*H, t, H, 1);
+  cur->f = this->bf+xProj.block(1*H, t, H, 1);
+  cur->o = this->bo+xProj.block(2*H, t, H, 1);
+  cur->u = this->bu+xProj.block(3*H, t, H, 1);
+
+  if (this->dropoutRateH > 0.0){
+    VecD masked = prev->h.array()*cur->maskHt.array();
+    cur->i.noalias() += this->Whi*masked;
+    cur->f.noalias() += this->Whf*masked;
+    cur->o.noalias() += this->Who*masked;
+    cur->u.noalias() += this->Whu*masked;
+  }
+  else {
+    cur->i.noalias() += this->Whi*prev->h;
+    cur->f.noalias() += this->Whf*prev->h;
+    cur->o.noalias() += this->Who*prev->h;
+    cur->u.noalias() += this->Whu*prev->h;
+  }
+
+  this->activate(prev, cur);
+}
+
+void LSTM::forwardSeq(const MatD& xs, std::vector<LSTM::State*>& state){
+  MatD xProj;
+
+  //the input dropout is applied by the step-wise forward, as in backwardSeq (and not at all by LnLSTM)
+  if (this->dropoutRateX > 0.0){
+    for (int t = 0; t < xs.cols(); ++t){
+      this->forward(xs.col(t), state[t], state[t+1]);
+    }
+
+    return;
+  }
+
+  this->projectInput(xs, xProj);
+
+  for (int t = 0; t < xs.cols(); ++t){
+    this->forward(xProj, t, state[t], state[t+1]);
+  }
+}
+
+void LSTM::backwardSeq(const MatD& xs, std::vector<LSTM::State*>& state, LSTM::Grad& grad){
+  const int H = this->bi.rows();
+  const int T = xs.cols();
+  MatD del(4*H, T); //deltas of the input, forget, output gates and the memory cell
+  MatD hs(H, T); //recurrent inputs
+
+  for (int t = T; t >= 1; --t){
+    LSTM::State* prev = state[t-1];
+    LSTM::State* cur = state[t];
+
+    prev->delc = VecD::Zero(H);
+    cur->delc.array() += ActFunc::tanhPrime(cur->cTanh).array()*cur->delh.array()*cur->o.array();
+    prev->delc.array() += cur->delc.array()*cur->f.array();
+    del.block(0*H, t-1, H, 1) = ActFunc::logisticPrime(cur->i).array()*cur->delc.array()*cur->u.array();
+    del.block(1*H, t-1, H, 1) = ActFunc::logisticPrime(cur->f).array()*cur->delc.array()*prev->c.array();
+    del.block(2*H, t-1, H, 1) = ActFunc::logisticPrime(cur->o).array()*cur->delh.array()*cur->cTanh.array();
+    del.block(3*H, t-1, H, 1) = ActFunc::tanhPrime(cur->u).array()*cur->delc.array()*cur->i.array();
+
+    prev->delh.noalias() +=
+      this->Whi.transpose()*del.block(0*H, t-1, H, 1)+
+      this->Whf.transpose()*del.block(1*H, t-1, H, 1)+
+      this->Who.transpose()*del.block(2*H, t-1, H, 1)+
+      this->Whu.transpose()*del.block(3*H, t-1, H, 1);
+
+    if (this->dropoutRateH > 0.0){
+      hs.col(t-1) = prev->h.array()*cur->maskHt.array();
+      prev->delh.array() *= cur->maskHt.array();
+    }
+    else {
+      hs.col(t-1) = prev->h;
+    }
+  }
+
+  MatD delx(xs.rows(), T);
+
+  delx.noalias() = this->Wxi.transpose()*del.middleRows(0*H, H);
+  delx.noalias() += this->Wxf.transpose()*del.middleRows(1*H, H);
+  delx.noalias() += this->Wxo.transpose()*del.middleRows(2*H, H);
+  delx.noalias() += this->Wxu.transpose()*del.middleRows(3*H, H);
+
+  if (this->dropoutRateX > 0.0){
+    MatD masked(xs.rows(), T);
+
+    for (int t = 0; t < T; ++t){
+      masked.col(t) = xs.col(t).array()*state[t+1]->maskXt.array();
+      state[t+1]->delx = delx.col(t).array()*state[t+1]->maskXt.array();
+    }
+
+    grad.Wxi.noalias() += del.middleRows(0*H, H)*masked.transpose();
+    grad.Wxf.noalias() += del.middleRows(1*H, H)*masked.transpose();
+    grad.Wxo.noalias() += del.middleRows(2*H, H)*masked.transpose();
+    grad.Wxu.noalias() += del.middleRows(3*H, H)*masked.transpose();
+  }
+  else {
+    for (int t = 0; t < T; ++t){
+      state[t+1]->delx = delx.col(t);
+    }
+
+    grad.Wxi.noalias() += del.middleRows(0*H, H)*xs.transpose();
+    grad.Wxf.noalias() += del.middleRows(1*H, H)*xs.transpose();
+    grad.Wxo.noalias() += del.middleRows(2*H, H)*xs.transpose();
+    grad.Wxu.noalias() += del.middleRows(3*H, H)*xs.transpose();
+  }
+
+  grad.Whi.noalias() += del.middleRows(0*H, H)*hs.transpose();
+  grad.Whf.noalias() += del.middleRows(1*H, H)*hs.transpose();
+  grad.Who.noalias() += del.middleRows(2*H, H)*hs.transpose();
+  grad.Whu.noalias() += del.middleRows(3*H, H)*hs.transpose();
+
+  grad.bi += del.middleRows(0*H, H).rowwise().sum();
+  grad.bf += del.middleRows(1*H, H).rowwise().sum();
+  grad.bo += del.middleRows(2*H, H).rowwise().sum();
+  grad.bu += del.middleRows(3*H, H).rowwise().sum();
+}
+
+void LSTM::release(LSTM::State* s, const bool keepState){
+  s->u = VecD();
+  s->i = VecD();
+  s->f = VecD();
+  s->o = VecD();
+  s->cTanh = VecD();
+
+  if (!keepState){
+    s->h = VecD();
+    s->c = VecD();
+  }
+}
+
+//the states are computed one by one so that the whole sequence of the activations is never kept at once
+void LSTM::forwardCheckpoint(const MatD& xs, std::vector<LSTM::State*>& state, const int k, MatD& hs){
+  const int T = xs.cols();
+
+  hs.resize(this->bi.rows(), T+1);
+  hs.col(0) = state[0]->h;
+
+  if (k <= 1){
+    this->forwardSeq(xs, state);
+
+    for (int t = 1; t <= T; ++t){
+      hs.col(t) = state[t]->h;
+    }
+
+    return;
+  }
+
+  for (int t = 0; t < T; ++t){
+    this->forward(xs.col(t), state[t], state[t+1]);
+    hs.col(t+1) = state[t+1]->h;
+
+    if (t >= 1){
+      this->release(state[t], t%k == 0);
+    }
+  }
+
+  if (T >= 1){
+    this->release(state[T], true);
+  }
+}
+
+//the segments between the checkpoints are recomputed and backpropagated one by one, from the last one
+unsigned long LSTM::backwardCheckpoint(const MatD& xs, std::vector<LSTM::State*>& state, LSTM::Grad& grad, const int k){
+  const int T = xs.cols();
+  unsigned long peak = 0;
+
+  if (k <= 1){
+    this->backwardSeq(xs, state, grad);
+    return peak;
+  }
+
+  for (int beg = ((T-1)/k)*k; beg >= 0; beg -= k){
+    const int end = std::min(beg+k, T);
+    std::vector<LSTM::State*> segment(state.begin()+beg, state.begin()+end+1);
+    unsigned long before = 0, after = 0;
+
+    for (int t = 1; t <= end-beg; ++t){
+      before += segment[t]->bytes();
+    }
+
+    this->forwardSeq(xs.middleCols(beg, end-beg), segment);
+
+    for (int t = 1; t <= end-beg; ++t){
+      after += segment[t]->bytes();
+    }
+
+    peak = std::max(peak, after-before);
+    this->backwardSeq(xs.middleCols(beg, end-beg), segment, grad);
+
+    for (int t = 1; t <= end-beg; ++t){
+      this->release(segment[t], t == end-beg);
+    }
+  }
+
+  return peak;
+}
+
+RNN::State* LSTM::newState() const {
+  return new LSTM::State;
+}
+
+RNN::Grad* LSTM::newGrad() const {
+  return new LSTM::Grad(*this);
+}
+
+int LSTM::stateDim() const {
+  return 2*this->bi.rows();
+}
+
+void LSTM::getState(const RNN::State* s, VecD& v) const {
+  const LSTM::State* state = (const LSTM::State*)s;
+  const int H = this->bi.rows();
+
+  v.resize(2*H);
+  v.head(H) = state->h;
+  v.tail(H) = state->c;
+}
+
+void LSTM::setState(const VecD& v, RNN::State* s) const {
+  LSTM::State* state = (LSTM::State*)s;
+  const int H = this->bi.rows();
+
+  state->h = v.head(H);
+  state->c = v.tail(H);
+}
+
+void LSTM::getStateGrad(const RNN::State* s, VecD& v) const {
+  const LSTM::State* state = (const LSTM::State*)s;
+  const int H = this->bi.rows();
+
+  v.resize(2*H);
+  v.head(H) = state->delh;
+  v.tail(H) = state->delc;
+}
+
+void LSTM::setStateGrad(const VecD& v, RNN::State* s) const {
+  LSTM::State* state = (LSTM::State*)s;
+  const int H = this->bi.rows();
+
+  state->delh += v.head(H);
+  state->delc = v.tail(H);
+}
+
+void LSTM::forward(const VecD& xt, const RNN::State* prev, RNN::State* cur){
+  this->forward(xt, (const LSTM::State*)prev, (LSTM::State*)cur);
+}
+
+void LSTM::forwardSeq(const MatD& xs, std::vector<RNN::State*>& state){
+  std::vector<LSTM::State*> seq(xs.cols()+1);
+
+  for (int t = 0; t <= xs.cols(); ++t){
+    seq[t] = (LSTM::State*)state[t];
+  }
+
+  this->forwardSeq(xs, seq);
+}
+
+void LSTM::backwardSeq(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad){
+  std::vector<LSTM::State*> seq(xs.cols()+1);
+
+  for (int t = 0; t <= xs.cols(); ++t){
+    seq[t] = (LSTM::State*)state[t];
+  }
+
+  this->backwardSeq(xs, seq, (LSTM::Grad&)grad);
+}
+
+void LSTM::forwardCheckpoint(const MatD& xs, std::vector<RNN::State*>& state, const int k, MatD& hs){
+  std::vector<LSTM::State*> seq(xs.cols()+1);
+
+  for (int t = 0; t <= xs.cols(); ++t){
+    seq[t] = (LSTM::State*)state[t];
+  }
+
+  this->forwardCheckpoint(xs, seq, k, hs);
+}
+
+unsigned long LSTM::backwardCheckpoint(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad, const int k){
+  std::vector<LSTM::State*> seq(xs.cols()+1);
+
+  for (int t = 0; t <= xs.cols(); ++t){
+    seq[t] = (LSTM::State*)state[t];
+  }
+
+  return this->backwardCheckpoint(xs, seq, (LSTM::Grad&)grad, k);
+}
+
+void LSTM::sgd(const RNN::Grad& grad, const Real learningRate){
+  this->sgd((const LSTM::Grad&)grad, learningRate);
+}
+
+void LSTM::registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg){
+  LSTM::Grad& g = (LSTM::Grad&)grad;
+
+  reg.add(prefix+"Wxi", this->Wxi, g.Wxi);
+  reg.add(prefix+"Whi", this->Whi, g.Whi);
+  reg.add(prefix+"bi", this->bi, g.bi);
+
+  reg.add(prefix+"Wxf", this->Wxf, g.Wxf);
+  reg.add(prefix+"Whf", this->Whf, g.Whf);
+  reg.add(prefix+"bf", this->bf, g.bf);
+
+  reg.add(prefix+"Wxo", this->Wxo, g.Wxo);
+  reg.add(prefix+"Who", this->Who, g.Who);
+  reg.add(prefix+"bo", this->bo, g.bo);
+
+  reg.add(prefix+"Wxu", this->Wxu, g.Wxu);
+  reg.add(prefix+"Whu", this->Whu, g.Whu);
+  reg.add(prefix+"bu", this->bu, g.bu);
+
+  //empty without additional input
+  reg.add(prefix+"Wai", this->Wai, g.Wai);
+  reg.add(prefix+"Waf", this->Waf, g.Waf);
+  reg.add(prefix+"Wao", this->Wao, g.Wao);
+  reg.add(prefix+"Wau", this->Wau, g.Wau);
+}
+
 void LSTM::sgd(const LSTM::Grad& grad, const Real learningRate){
   this->Wxi -= learningRate*grad.Wxi;
   this->Whi -= learningRate*grad.Whi;
@@ -551,6 +882,12 @@ void LSTM::State::clear(){
   this->dela = VecD();
 }
 
+unsigned long LSTM::State::bytes(){
+  return sizeof(Real)*(this->h.size()+this->c.size()+this->u.size()+this->i.size()+this->f.size()+this->o.size()+this->cTanh.size()+
+		       this->maskXt.size()+this->maskAt.size()+this->maskHt.size()+
+		       this->delh.size()+this->delc.size()+this->delx.size()+this->dela.size());
+}
+
 LSTM::Grad::Grad(const LSTM& lstm):
   gradHist(0)
 {
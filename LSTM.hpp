@@ -1,10 +1,12 @@
 #pragma once
 
+#include "RNN.hpp"
 #include "Matrix.hpp"
 #include "Rand.hpp"
 #include <fstream>
+#include <vector>
 
-class LSTM{
+class LSTM : public RNN{
 public:
   LSTM(){};
   LSTM(const int inputDim, const int hiddenDim);
@@ -39,25 +41,56 @@ public:
   virtual void backward(LSTM::State* prev, LSTM::State* cur, LSTM::Grad& grad, const VecD& xt, const VecD& at);
   virtual void backward(LSTM::State* cur, LSTM::Grad& grad, const VecD& xt, const VecD& at);
 
+  //for whole sequences: state[0] is the initial state and state[t+1] corresponds to xs.col(t)
+  virtual void projectInput(const MatD& xs, MatD& xProj);
+  //xProj.col(t) is the projection of the input of cur without the dropout mask, so forwardSeq does not use it with dropoutRateX > 0
+  virtual void forward(const MatD& xProj, const int t, const LSTM::State* prev, LSTM::State* cur);
+  void forwardSeq(const MatD& xs, std::vector<LSTM::State*>& state);
+  //delh of all the states and delc of the last state should be initialized; the weight gradients are computed once per sequence
+  virtual void backwardSeq(const MatD& xs, std::vector<LSTM::State*>& state, LSTM::Grad& grad);
+
+  //gradient checkpointing: the activations of each state are dropped as soon as the next state is computed, and only h and c
+  //of every k-th state (and the last one) are kept; the rest is recomputed segment by segment in backward
+  virtual void release(LSTM::State* s, const bool keepState);
+  void forwardCheckpoint(const MatD& xs, std::vector<LSTM::State*>& state, const int k, MatD& hs);
+  unsigned long backwardCheckpoint(const MatD& xs, std::vector<LSTM::State*>& state, LSTM::Grad& grad, const int k);
+
+  //RNN interface (the recurrent state is [h; c])
+  RNN::State* newState() const;
+  RNN::Grad* newGrad() const;
+  int stateDim() const;
+  void getState(const RNN::State* s, VecD& v) const;
+  void setState(const VecD& v, RNN::State* s) const;
+  void getStateGrad(const RNN::State* s, VecD& v) const;
+  void setStateGrad(const VecD& v, RNN::State* s) const;
+  void forward(const VecD& xt, const RNN::State* prev, RNN::State* cur);
+  void forwardSeq(const MatD& xs, std::vector<RNN::State*>& state);
+  void backwardSeq(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad);
+  void forwardCheckpoint(const MatD& xs, std::vector<RNN::State*>& state, const int k, MatD& hs);
+  unsigned long backwardCheckpoint(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad, const int k);
+  void sgd(const RNN::Grad& grad, const Real learningRate);
+  void registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg);
+
   void dropout(bool isTest);
   void operator += (const LSTM& lstm);
   void operator /= (const Real val);
 };
 
-class LSTM::State{
+class LSTM::State: public RNN::State{
 public:
   virtual ~State() {this->clear();};
 
-  VecD h, c, u, i, f, o;
+  VecD c, u, i, f, o;
   VecD cTanh;
   VecD maskXt, maskAt, maskHt; //for dropout
 
-  VecD delh, delc, delx, dela; //for backprop
+  VecD delc, dela; //for backprop
 
   virtual void clear();
+  unsigned long bytes();
 };
 
-class LSTM::Grad{
+class LSTM::Grad: public RNN::Grad{
 public:
   Grad(): gradHist(0) {}
   Grad(const LSTM& lstm);
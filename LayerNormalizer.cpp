@@ -1,5 +1,6 @@
 #include "LayerNormalizer.hpp"
 #include "Utils.hpp"
+#include "ParamRegistry.hpp"
 #include <iostream>
 
 LayerNormalizer::LayerNormalizer(const int dim){
@@ -14,9 +15,10 @@ void LayerNormalizer::init(){
 
 void LayerNormalizer::forward(VecD& at, LayerNormalizer::State* state){
   const unsigned int H = at.rows();
+  const Real EPS = 1.0e-05; //for constant inputs (e.g., the zero initial state)
 
   state->yt = at.array()-at.sum()/H;
-  state->sigma = sqrt(state->yt.squaredNorm()/H);
+  state->sigma = sqrt(state->yt.squaredNorm()/H+EPS);
   state->xt = (1.0/state->sigma)*this->g;
   at = this->b;
   at.array() += state->xt.array()*state->yt.array();
@@ -45,6 +47,11 @@ void LayerNormalizer::sgd(const LayerNormalizer::Grad& grad, const Real learning
   this->b -= learningRate*grad.b;
 }
 
+void LayerNormalizer::registerParams(LayerNormalizer::Grad& grad, const std::string& prefix, ParamRegistry& reg){
+  reg.add(prefix+"g", this->g, grad.g);
+  reg.add(prefix+"b", this->b, grad.b);
+}
+
 void LayerNormalizer::save(std::ofstream& ofs){
   Utils::save(ofs, this->g);
   Utils::save(ofs, this->b);
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Matrix.hpp"
+#include <string>
+
+class ParamRegistry;
 
 class LayerNormalizer{
 public:
@@ -16,6 +19,7 @@ public:
   void forward(VecD& at, LayerNormalizer::State* state);
   void backward(const VecD& delat, VecD& delatOrig, LayerNormalizer::State* state, LayerNormalizer::Grad& grad);
   void sgd(const LayerNormalizer::Grad& grad, const Real learningRate);
+  void registerParams(LayerNormalizer::Grad& grad, const std::string& prefix, ParamRegistry& reg);
 
   void save(std::ofstream& ofs);
   void load(std::ifstream& ifs);
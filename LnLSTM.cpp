@@ -1,5 +1,6 @@
 #include "LnLSTM.hpp"
 #include "ActFunc.hpp"
+#include "ParamRegistry.hpp"
 
 LnLSTM::LnLSTM(const int inputDim, const int hiddenDim):
   LSTM(inputDim, hiddenDim)
@@ -91,6 +92,38 @@ void LnLSTM::forward(const VecD& xt, LSTM::State* cur){
   cur->h = cur->o.array()*cur->cTanh.array();
 }
 
+void LnLSTM::forward(const MatD& xProj, const int t, const LSTM::State* prev, LSTM::State* cur){
+  const unsigned int H = this->bi.rows();
+  LnLSTM::State* state = (LnLSTM::State*)cur;
+
+  state->lnhConcat = VecD(4*H);
+
+  state->lnhConcat.segment(0*H, H).noalias() = this->Whi*prev->h;
+  state->lnhConcat.segment(1*H, H).noalias() = this->Whf*prev->h;
+  state->lnhConcat.segment(2*H, H).noalias() = this->Who*prev->h;
+  state->lnhConcat.segment(3*H, H).noalias() = this->Whu*prev->h;
+  this->lnh.forward(state->lnhConcat, state->lnsh);
+
+  state->lnxConcat = xProj.col(t);
+  this->lnx.forward(state->lnxConcat, state->lnsx);
+
+  cur->i = this->bi+state->lnhConcat.segment(0*H, H)+state->lnxConcat.segment(0*H, H);
+  cur->f = this->bf+state->lnhConcat.segment(1*H, H)+state->lnxConcat.segment(1*H, H);
+  cur->o = this->bo+state->lnhConcat.segment(2*H, H)+state->lnxConcat.segment(2*H, H);
+  cur->u = this->bu+state->lnhConcat.segment(3*H, H)+state->lnxConcat.segment(3*H, H);
+
+  ActFunc::logistic(cur->i);
+  ActFunc::logistic(cur->f);
+  ActFunc::logistic(cur->o);
+  ActFunc::tanh(cur->u);
+
+  cur->c = cur->i.array()*cur->u.array() + cur->f.array()*prev->c.array();
+  cur->cTanh = cur->c;
+  this->lnc.forward(cur->cTanh, state->lnsc);
+  ActFunc::tanh(cur->cTanh);
+  cur->h = cur->o.array()*cur->cTanh.array();
+}
+
 void LnLSTM::backward(LSTM::State* prev, LSTM::State* cur, LSTM::Grad& grad, const VecD& xt){
   const unsigned int H = this->bi.rows();
   LnLSTM::State* state = (LnLSTM::State*)cur;
@@ -140,6 +173,84 @@ void LnLSTM::backward(LSTM::State* prev, LSTM::State* cur, LSTM::Grad& grad, con
   grad.bu += state->delConcat.segment(H*3, H);
 }
 
+void LnLSTM::backwardSeq(const MatD& xs, std::vector<LSTM::State*>& state, LSTM::Grad& grad){
+  const unsigned int H = this->bi.rows();
+  const int T = xs.cols();
+  LnLSTM::Grad& gg = (LnLSTM::Grad&)grad;
+  MatD delx(4*H, T), delh(4*H, T), hs(H, T); //deltas before the layer normalization
+  VecD delc, delhConcat, delxConcat;
+
+  for (int t = T; t >= 1; --t){
+    LSTM::State* prev = state[t-1];
+    LSTM::State* cur = state[t];
+    LnLSTM::State* lnState = (LnLSTM::State*)cur;
+
+    prev->delc = VecD::Zero(H);
+    this->lnc.backward(ActFunc::tanhPrime(cur->cTanh).array()*cur->delh.array()*cur->o.array(), delc, lnState->lnsc, gg.lnc);
+    cur->delc += delc;
+    prev->delc.array() += cur->delc.array()*cur->f.array();
+
+    lnState->delConcat = VecD(4*H);
+    lnState->delConcat.segment(0*H, H) = ActFunc::logisticPrime(cur->i).array()*cur->delc.array()*cur->u.array();
+    lnState->delConcat.segment(1*H, H) = ActFunc::logisticPrime(cur->f).array()*cur->delc.array()*prev->c.array();
+    lnState->delConcat.segment(2*H, H) = ActFunc::logisticPrime(cur->o).array()*cur->delh.array()*cur->cTanh.array();
+    lnState->delConcat.segment(3*H, H) = ActFunc::tanhPrime(cur->u).array()*cur->delc.array()*cur->i.array();
+    this->lnh.backward(lnState->delConcat, delhConcat, lnState->lnsh, gg.lnh);
+    this->lnx.backward(lnState->delConcat, delxConcat, lnState->lnsx, gg.lnx);
+
+    prev->delh.noalias() +=
+      this->Whi.transpose()*delhConcat.segment(H*0, H)+
+      this->Whf.transpose()*delhConcat.segment(H*1, H)+
+      this->Who.transpose()*delhConcat.segment(H*2, H)+
+      this->Whu.transpose()*delhConcat.segment(H*3, H);
+
+    delx.col(t-1) = delxConcat;
+    delh.col(t-1) = delhConcat;
+    hs.col(t-1) = prev->h;
+    grad.bi += lnState->delConcat.segment(H*0, H);
+    grad.bf += lnState->delConcat.segment(H*1, H);
+    grad.bo += lnState->delConcat.segment(H*2, H);
+    grad.bu += lnState->delConcat.segment(H*3, H);
+  }
+
+  MatD dx(xs.rows(), T);
+
+  dx.noalias() = this->Wxi.transpose()*delx.middleRows(0*H, H);
+  dx.noalias() += this->Wxf.transpose()*delx.middleRows(1*H, H);
+  dx.noalias() += this->Wxo.transpose()*delx.middleRows(2*H, H);
+  dx.noalias() += this->Wxu.transpose()*delx.middleRows(3*H, H);
+
+  for (int t = 0; t < T; ++t){
+    state[t+1]->delx = dx.col(t);
+  }
+
+  grad.Wxi.noalias() += delx.middleRows(0*H, H)*xs.transpose();
+  grad.Whi.noalias() += delh.middleRows(0*H, H)*hs.transpose();
+
+  grad.Wxf.noalias() += delx.middleRows(1*H, H)*xs.transpose();
+  grad.Whf.noalias() += delh.middleRows(1*H, H)*hs.transpose();
+
+  grad.Wxo.noalias() += delx.middleRows(2*H, H)*xs.transpose();
+  grad.Who.noalias() += delh.middleRows(2*H, H)*hs.transpose();
+
+  grad.Wxu.noalias() += delx.middleRows(3*H, H)*xs.transpose();
+  grad.Whu.noalias() += delh.middleRows(3*H, H)*hs.transpose();
+}
+
+//the normalization states are recomputed with the gates
+void LnLSTM::release(LSTM::State* s, const bool keepState){
+  LnLSTM::State* state = (LnLSTM::State*)s;
+
+  LSTM::release(s, keepState);
+  state->lnsh->clear();
+  state->lnsx->clear();
+  state->lnsc->clear();
+  state->lnsa->clear();
+  state->lnhConcat = VecD();
+  state->lnxConcat = VecD();
+  state->lnaConcat = VecD();
+}
+
 void LnLSTM::backward(LSTM::State* cur, LSTM::Grad& grad, const VecD& xt){
   const unsigned int H = this->bi.rows();
   LnLSTM::State* state = (LnLSTM::State*)cur;
@@ -286,6 +397,28 @@ void LnLSTM::sgd(const LnLSTM::Grad& grad, const Real learningRate){
   this->lna.sgd(grad.lna, learningRate);
 }
 
+void LnLSTM::sgd(const RNN::Grad& grad, const Real learningRate){
+  this->sgd((const LnLSTM::Grad&)grad, learningRate);
+}
+
+void LnLSTM::registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg){
+  LnLSTM::Grad& g = (LnLSTM::Grad&)grad;
+
+  LSTM::registerParams(grad, prefix, reg);
+  this->lnh.registerParams(g.lnh, prefix+"lnh.", reg);
+  this->lnx.registerParams(g.lnx, prefix+"lnx.", reg);
+  this->lnc.registerParams(g.lnc, prefix+"lnc.", reg);
+  this->lna.registerParams(g.lna, prefix+"lna.", reg);
+}
+
+RNN::State* LnLSTM::newState() const {
+  return new LnLSTM::State;
+}
+
+RNN::Grad* LnLSTM::newGrad() const {
+  return new LnLSTM::Grad(*this);
+}
+
 void LnLSTM::save(std::ofstream& ofs){
   LSTM::save(ofs);
   this->lnh.save(ofs);
@@ -315,6 +448,13 @@ void LnLSTM::State::clear(){
   this->delConcat = VecD();
 }
 
+unsigned long LnLSTM::State::bytes(){
+  return LSTM::State::bytes()+
+    sizeof(Real)*(this->lnsh->xt.size()+this->lnsh->yt.size()+this->lnsx->xt.size()+this->lnsx->yt.size()+
+		  this->lnsc->xt.size()+this->lnsc->yt.size()+this->lnsa->xt.size()+this->lnsa->yt.size()+
+		  this->lnhConcat.size()+this->lnxConcat.size()+this->lnaConcat.size()+this->delConcat.size());
+}
+
 LnLSTM::Grad::Grad(const LnLSTM& lnlstm):
   LSTM::Grad(lnlstm)
 {
@@ -337,9 +477,10 @@ Real LnLSTM::Grad::norm(){
 }
 
 void LnLSTM::Grad::operator += (const LnLSTM::Grad& grad){
-  (LSTM::Grad)(*this) += (LSTM::Grad)grad; //???
+  LSTM::Grad::operator += (grad);
   this->lnh += grad.lnh;
   this->lnx += grad.lnx;
   this->lnc += grad.lnc;
   this->lna += grad.lna;
 }
+
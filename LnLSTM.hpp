@@ -23,6 +23,15 @@ public:
   void save(std::ofstream& ofs);
   void load(std::ifstream& ifs);
 
+  void forward(const MatD& xProj, const int t, const LSTM::State* prev, LSTM::State* cur);
+  void backwardSeq(const MatD& xs, std::vector<LSTM::State*>& state, LSTM::Grad& grad);
+  void release(LSTM::State* s, const bool keepState);
+
+  RNN::State* newState() const;
+  RNN::Grad* newGrad() const;
+  void sgd(const RNN::Grad& grad, const Real learningRate);
+  void registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg);
+
   void forward(const VecD& xt, const VecD& at, const LSTM::State* prev, LSTM::State* cur);
   void backward(LSTM::State* prev, LSTM::State* cur, LSTM::Grad& grad, const VecD& xt, const VecD& at);
 };
@@ -45,6 +54,7 @@ public:
   VecD delConcat;
 
   void clear();
+  unsigned long bytes();
 };
 
 class LnLSTM::Grad: public LSTM::Grad{
@@ -0,0 +1,151 @@
+#include "Numa.hpp"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+//e.g., "0-3,8-11"
+void Numa::parseList(const char* str, std::vector<int>& res){
+  std::istringstream iss(str);
+
+  res.clear();
+
+  for (std::string range; std::getline(iss, range, ','); ){
+    const size_t dash = range.find('-');
+    const int beg = atoi(range.c_str());
+    const int end = (dash == std::string::npos ? beg : atoi(range.c_str()+dash+1));
+
+    for (int i = beg; i <= end; ++i){
+      res.push_back(i);
+    }
+  }
+}
+
+//the cpus of each node; one node with all the cpus if sysfs is not available
+const std::vector<std::vector<int> >& Numa::topology(){
+  static std::vector<std::vector<int> > res;
+  static bool loaded = false;
+
+#pragma omp critical (NumaTopology)
+  {
+    if (!loaded){
+      for (int node = 0; ; ++node){
+	std::ostringstream path;
+
+	path << "/sys/devices/system/node/node" << node << "/cpulist";
+
+	std::ifstream ifs(path.str().c_str());
+	std::string line;
+
+	if (!ifs || !std::getline(ifs, line)){
+	  break;
+	}
+
+	res.push_back(std::vector<int>());
+	Numa::parseList(line.c_str(), res.back());
+      }
+
+      if (res.empty()){
+	res.push_back(std::vector<int>());
+
+	for (int i = 0, n = sysconf(_SC_NPROCESSORS_ONLN); i < n; ++i){
+	  res.back().push_back(i);
+	}
+      }
+
+      loaded = true;
+    }
+  }
+
+  return res;
+}
+
+int Numa::nodeNum(){
+  return Numa::topology().size();
+}
+
+const std::vector<int>& Numa::cpus(const int node){
+  return Numa::topology()[node];
+}
+
+int Numa::pin(const int id){
+  const int num = Numa::nodeNum();
+
+  return Numa::pinToNode(id%num, id/num);
+}
+
+int Numa::pinToNode(const int node, const int id){
+  const std::vector<int>& cpu = Numa::cpus(node);
+  cpu_set_t set;
+
+  if (cpu.empty()){
+    return -1;
+  }
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu[id%cpu.size()], &set);
+
+  return (sched_setaffinity(0, sizeof(set), &set) == 0 ? node : -1);
+}
+
+std::vector<int> Numa::affinity(){
+  std::vector<int> res;
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+
+  if (sched_getaffinity(0, sizeof(set), &set) == 0){
+    for (int i = 0; i < CPU_SETSIZE; ++i){
+      if (CPU_ISSET(i, &set)){
+	res.push_back(i);
+      }
+    }
+  }
+
+  return res;
+}
+
+bool Numa::setAffinity(const std::vector<int>& cpu){
+  cpu_set_t set;
+
+  if (cpu.empty()){
+    return false;
+  }
+
+  CPU_ZERO(&set);
+
+  for (auto it = cpu.begin(); it != cpu.end(); ++it){
+    CPU_SET(*it, &set);
+  }
+
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+int Numa::node(){
+  const int cur = sched_getcpu();
+
+  for (int node = 0; node < Numa::nodeNum(); ++node){
+    for (auto it = Numa::cpus(node).begin(); it != Numa::cpus(node).end(); ++it){
+      if (*it == cur){
+	return node;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int Numa::pageNode(const void* ptr){
+  void* page = (void*)((unsigned long)ptr & ~((unsigned long)sysconf(_SC_PAGESIZE)-1));
+  int status = -1;
+
+  //move_pages without the target nodes only queries the current ones
+  if (syscall(SYS_move_pages, 0, 1, &page, 0, &status, 0) != 0){
+    return -1;
+  }
+
+  return (status >= 0 ? status : -1);
+}
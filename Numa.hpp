@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+//NUMA topology (from sysfs), thread pinning and the node of memory pages, without libnuma;
+//the pages are placed by first touch, i.e., on the node of the thread writing them first
+class Numa{
+public:
+  static int nodeNum();
+  static const std::vector<int>& cpus(const int node);
+  //pins the calling thread to a core; the threads 0, 1, ... are spread over the nodes round robin; returns its node (-1: failed)
+  static int pin(const int id);
+  //pins the calling thread to the id-th core of the node
+  static int pinToNode(const int node, const int id = 0);
+  //the cpus the calling thread may run on, e.g., to restore the master thread after a pinned parallel region
+  static std::vector<int> affinity();
+  static bool setAffinity(const std::vector<int>& cpu);
+  //the node of the cpu running the calling thread
+  static int node();
+  //the node of the page of ptr (-1: unknown, e.g., not touched yet)
+  static int pageNode(const void* ptr);
+
+private:
+  static const std::vector<std::vector<int> >& topology();
+  static void parseList(const char* str, std::vector<int>& res);
+};
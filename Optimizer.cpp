@@ -1,4 +1,60 @@
 #include "Optimizer.hpp"
+#include <cassert>
+
+void Optimizer::step(const Real gradScale_){
+  ++this->t;
+  this->gradScale = gradScale_;
+}
+
+Optimizer::Moment& Optimizer::moment(const std::string& name, const int rows, const int cols){
+  auto it = this->moments.find(name);
+
+  if (it == this->moments.end()){
+    Optimizer::Moment& res = this->moments[name];
+
+    res.m = MatD::Zero(rows, cols);
+    res.v = MatD::Zero(rows, cols);
+    return res;
+  }
+
+  //the parameter should not be resized after the moments are allocated
+  assert(it->second.m.rows() == rows && it->second.m.cols() == cols);
+  return it->second;
+}
+
+void Optimizer::update(const VecD& grad, const Real learningRate, Optimizer::Moment& mom, MatD& param, const int col){
+  const int offset = col*param.rows(); //column major
+
+  this->update(grad.data(), grad.size(), learningRate, mom.m.data()+offset, mom.v.data()+offset, param.data()+offset);
+}
+
+void Optimizer::update(const Real grad, const Real learningRate, Optimizer::Moment& mom, VecD& param, const int row){
+  this->update(&grad, 1, learningRate, mom.m.data()+row, mom.v.data()+row, param.data()+row);
+}
+
+void Optimizer::update(const Real* grad, const int size, const Real learningRate, Real* m, Real* v, Real* param){
+  switch (this->type){
+  case Optimizer::ADAGRAD:
+    Optimizer::adagrad(grad, size, this->gradScale, learningRate, this->eps, v, param);
+    break;
+  case Optimizer::MOMENTUM:
+    Optimizer::momentum(grad, size, this->gradScale, learningRate, this->beta1, m, param);
+    break;
+  case Optimizer::RMSPROP:
+    Optimizer::rmsprop(grad, size, this->gradScale, learningRate, this->beta2, this->eps, v, param);
+    break;
+  case Optimizer::ADAM:
+  case Optimizer::ADAMW:
+    Optimizer::adam(grad, size, this->gradScale, learningRate, this->beta1, this->beta2, this->eps,
+		    1.0/(1.0-pow(this->beta1, this->t)), 1.0/(1.0-pow(this->beta2, this->t)),
+		    (this->type == Optimizer::ADAMW ? this->weightDecay : 0.0), m, v, param);
+    break;
+  default:
+    for (int i = 0; i < size; ++i){
+      param[i] -= learningRate*this->gradScale*grad[i];
+    }
+  }
+}
 
 void Optimizer::sgd(const MatD& grad, const Real learningRate, MatD& param){
   param -= learningRate*grad;
@@ -9,25 +65,58 @@ void Optimizer::sgd(const VecD& grad, const Real learningRate, VecD& param){
 }
 
 void Optimizer::adagrad(MatD& grad, const Real learningRate, MatD& gradHist, MatD& param){
-  gradHist.array() += grad.array().square();
-  grad.array() /= gradHist.array().sqrt();
-  Optimizer::sgd(grad, learningRate, param);
+  Optimizer::adagrad(grad.data(), grad.size(), 1.0, learningRate, 0.0, gradHist.data(), param.data());
 }
 
 void Optimizer::adagrad(VecD& grad, const Real learningRate, VecD& gradHist, VecD& param){
-  gradHist.array() += grad.array().square();
-  grad.array() /= gradHist.array().sqrt();
-  Optimizer::sgd(grad, learningRate, param);
+  Optimizer::adagrad(grad.data(), grad.size(), 1.0, learningRate, 0.0, gradHist.data(), param.data());
 }
 
 void Optimizer::momentum(MatD& grad, const Real learningRate, const Real m, MatD& gradHist, MatD& param){
-  gradHist.array() *= m;
-  Optimizer::sgd(grad, -learningRate, gradHist);
-  Optimizer::sgd(gradHist, 1.0, param);
+  Optimizer::momentum(grad.data(), grad.size(), 1.0, learningRate, m, gradHist.data(), param.data());
 }
 
 void Optimizer::momentum(VecD& grad, const Real learningRate, const Real m, VecD& gradHist, VecD& param){
-  gradHist.array() *= m;
-  Optimizer::sgd(grad, -learningRate, gradHist);
-  Optimizer::sgd(gradHist, 1.0, param);
+  Optimizer::momentum(grad.data(), grad.size(), 1.0, learningRate, m, gradHist.data(), param.data());
+}
+
+void Optimizer::adagrad(const Real* grad, const int size, const Real gradScale, const Real learningRate, const Real eps, Real* v, Real* param){
+#pragma omp simd
+  for (int i = 0; i < size; ++i){
+    const Real g = gradScale*grad[i];
+
+    v[i] += g*g;
+    param[i] -= learningRate*g/(sqrt(v[i])+eps);
+  }
+}
+
+void Optimizer::momentum(const Real* grad, const int size, const Real gradScale, const Real learningRate, const Real beta, Real* m, Real* param){
+#pragma omp simd
+  for (int i = 0; i < size; ++i){
+    m[i] = beta*m[i]-learningRate*gradScale*grad[i];
+    param[i] += m[i];
+  }
+}
+
+void Optimizer::rmsprop(const Real* grad, const int size, const Real gradScale, const Real learningRate, const Real beta, const Real eps, Real* v, Real* param){
+#pragma omp simd
+  for (int i = 0; i < size; ++i){
+    const Real g = gradScale*grad[i];
+
+    v[i] = beta*v[i]+(1.0-beta)*g*g;
+    param[i] -= learningRate*g/(sqrt(v[i])+eps);
+  }
+}
+
+//correction1 = 1/(1-beta1^t) and correction2 = 1/(1-beta2^t)
+void Optimizer::adam(const Real* grad, const int size, const Real gradScale, const Real learningRate, const Real beta1, const Real beta2, const Real eps,
+		     const Real correction1, const Real correction2, const Real weightDecay, Real* m, Real* v, Real* param){
+#pragma omp simd
+  for (int i = 0; i < size; ++i){
+    const Real g = gradScale*grad[i];
+
+    m[i] = beta1*m[i]+(1.0-beta1)*g;
+    v[i] = beta2*v[i]+(1.0-beta2)*g*g;
+    param[i] -= learningRate*(correction1*m[i]/(sqrt(correction2*v[i])+eps)+weightDecay*param[i]);
+  }
 }
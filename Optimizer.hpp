@@ -1,13 +1,68 @@
 #pragma once
 
 #include "Matrix.hpp"
+#include <string>
+#include <unordered_map>
 
 class Optimizer{
 public:
+  enum TYPE{
+    SGD,
+    ADAGRAD,
+    MOMENTUM,
+    RMSPROP,
+    ADAM,
+    ADAMW,
+  };
+
+  Optimizer(const Optimizer::TYPE type_ = Optimizer::SGD):
+    type(type_), beta1(0.9), beta2(0.999), eps(1.0e-08), weightDecay(0.01), t(0), gradScale(1.0)
+  {
+    if (this->type == Optimizer::RMSPROP){
+      this->beta2 = 0.9;
+    }
+  };
+
+  class Moment;
+
+  Optimizer::TYPE type;
+  Real beta1; //for ADAM/ADAMW (and the momentum of MOMENTUM)
+  Real beta2; //for ADAM/ADAMW (and the decay rate of RMSPROP)
+  Real eps;
+  Real weightDecay; //decoupled weight decay of ADAMW
+  int t; //# of steps, for the bias correction
+  Real gradScale; //the gradients are multiplied by this in the updates (e.g., 1/the mini-batch size and the clipping)
+
+  //called once per mini batch before the updates
+  void step(const Real gradScale_ = 1.0);
+  //the moments of a parameter, by its name (e.g., that of ParamRegistry::View); allocated at the first call, which is not thread-safe
+  Optimizer::Moment& moment(const std::string& name, const int rows, const int cols);
+  //lazy updates of the rows tracked in the sparse gradients (e.g., embeddings and BlackOut);
+  //only the given column (or coefficient) and its moments are touched
+  void update(const VecD& grad, const Real learningRate, Optimizer::Moment& mom, MatD& param, const int col);
+  void update(const Real grad, const Real learningRate, Optimizer::Moment& mom, VecD& param, const int row);
+  //raw updates of a part of a parameter (e.g., a chunk of ParamRegistry)
+  void update(const Real* grad, const int size, const Real learningRate, Real* m, Real* v, Real* param);
+
   static void sgd(const MatD& grad, const Real learningRate, MatD& param);
   static void sgd(const VecD& grad, const Real learningRate, VecD& param);
   static void adagrad(MatD& grad, const Real learningRate, MatD& gradHist, MatD& param);
   static void adagrad(VecD& grad, const Real learningRate, VecD& gradHist, VecD& param);
   static void momentum(MatD& grad, const Real learningRate, const Real m, MatD& gradHist, MatD& param);
   static void momentum(VecD& grad, const Real learningRate, const Real m, VecD& gradHist, VecD& param);
+
+  //fused single-pass kernels over the parameter, gradient and moment buffers; the gradient is scaled by gradScale
+  static void adagrad(const Real* grad, const int size, const Real gradScale, const Real learningRate, const Real eps, Real* v, Real* param);
+  static void momentum(const Real* grad, const int size, const Real gradScale, const Real learningRate, const Real beta, Real* m, Real* param);
+  static void rmsprop(const Real* grad, const int size, const Real gradScale, const Real learningRate, const Real beta, const Real eps, Real* v, Real* param);
+  static void adam(const Real* grad, const int size, const Real gradScale, const Real learningRate, const Real beta1, const Real beta2, const Real eps,
+		   const Real correction1, const Real correction2, const Real weightDecay, Real* m, Real* v, Real* param);
+
+private:
+  std::unordered_map<std::string, Optimizer::Moment> moments;
+};
+
+class Optimizer::Moment{
+public:
+  MatD m, v; //the first and second moments (m is not used by ADAGRAD and RMSPROP, nor v by MOMENTUM)
 };
@@ -0,0 +1,251 @@
+#include "ParamRegistry.hpp"
+#include "Optimizer.hpp"
+#include <cassert>
+#include <algorithm>
+
+void ParamRegistry::add(const std::string& name, MatD& param, MatD& grad){
+  assert(param.rows() == grad.rows() && param.cols() == grad.cols());
+  this->add(ParamRegistry::View(name, param, grad));
+}
+
+void ParamRegistry::add(const std::string& name, VecD& param, VecD& grad){
+  assert(param.rows() == grad.rows());
+  this->add(ParamRegistry::View(name, param, grad));
+}
+
+void ParamRegistry::add(const ParamRegistry::View& v){
+  const int size = v.rows*v.cols;
+
+  if (size == 0){
+    return;
+  }
+
+  this->view.push_back(v);
+  this->view.back().offset = this->size;
+
+  for (int i = 0; i < size; i += ParamRegistry::CHUNK_SIZE){
+    this->chunk.push_back(ParamRegistry::Chunk(this->view.size()-1, i, std::min(ParamRegistry::CHUNK_SIZE, size-i)));
+  }
+
+  this->size += size;
+}
+
+void ParamRegistry::clear(){
+  this->view.clear();
+  this->chunk.clear();
+  this->size = 0;
+}
+
+const ParamRegistry::View* ParamRegistry::find(const std::string& name) const {
+  for (auto it = this->view.begin(); it != this->view.end(); ++it){
+    if (it->name == name){
+      return &(*it);
+    }
+  }
+
+  return 0;
+}
+
+bool ParamRegistry::valid() const {
+  for (auto it = this->view.begin(); it != this->view.end(); ++it){
+    if (!it->valid()){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void ParamRegistry::zero(){
+  assert(this->valid());
+
+#pragma omp parallel for num_threads(this->numThreads) schedule(static)
+  for (int i = 0; i < (int)this->chunk.size(); ++i){
+    const ParamRegistry::Chunk& c = this->chunk[i];
+    Real* grad = this->view[c.view].grad+c.begin;
+
+#pragma omp simd
+    for (int j = 0; j < c.size; ++j){
+      grad[j] = 0.0;
+    }
+  }
+}
+
+Real ParamRegistry::squaredNorm() const {
+  Real res = 0.0;
+
+  assert(this->valid());
+
+#pragma omp parallel for num_threads(this->numThreads) schedule(static) reduction(+:res)
+  for (int i = 0; i < (int)this->chunk.size(); ++i){
+    const ParamRegistry::Chunk& c = this->chunk[i];
+    const Real* grad = this->view[c.view].grad+c.begin;
+    Real sum = 0.0;
+
+#pragma omp simd reduction(+:sum)
+    for (int j = 0; j < c.size; ++j){
+      sum += grad[j]*grad[j];
+    }
+
+    res += sum;
+  }
+
+  return res;
+}
+
+Real ParamRegistry::reduce(const std::vector<ParamRegistry*>& reg){
+  Real res = 0.0;
+
+  assert(this->valid());
+
+  for (auto it = reg.begin(); it != reg.end(); ++it){
+    assert((*it)->valid() && (*it)->size == this->size);
+  }
+
+#pragma omp parallel for num_threads(this->numThreads) schedule(static) reduction(+:res)
+  for (int i = 0; i < (int)this->chunk.size(); ++i){
+    const ParamRegistry::Chunk& c = this->chunk[i];
+    Real* grad = this->view[c.view].grad+c.begin;
+    Real sum = 0.0;
+
+#pragma omp simd
+    for (int j = 0; j < c.size; ++j){
+      grad[j] = 0.0;
+    }
+
+    //the chunk stays in cache while all the gradients are added
+    for (auto it = reg.begin(); it != reg.end(); ++it){
+      Real* src = (*it)->view[c.view].grad+c.begin;
+
+#pragma omp simd
+      for (int j = 0; j < c.size; ++j){
+	grad[j] += src[j];
+	src[j] = 0.0;
+      }
+    }
+
+#pragma omp simd reduction(+:sum)
+    for (int j = 0; j < c.size; ++j){
+      sum += grad[j]*grad[j];
+    }
+
+    res += sum;
+  }
+
+  return res;
+}
+
+void ParamRegistry::sgd(const Real learningRate){
+  assert(this->valid());
+
+#pragma omp parallel for num_threads(this->numThreads) schedule(static)
+  for (int i = 0; i < (int)this->chunk.size(); ++i){
+    const ParamRegistry::Chunk& c = this->chunk[i];
+    Real* param = this->view[c.view].param+c.begin;
+    const Real* grad = this->view[c.view].grad+c.begin;
+
+#pragma omp simd
+    for (int j = 0; j < c.size; ++j){
+      param[j] -= learningRate*grad[j];
+    }
+  }
+}
+
+void ParamRegistry::getGrad(const unsigned long begin, const unsigned long end, Real* buf) const {
+  assert(this->valid());
+
+  for (auto it = this->view.begin(); it != this->view.end(); ++it){
+    const unsigned long b = std::max(begin, it->offset);
+    const unsigned long e = std::min(end, it->offset+it->rows*it->cols);
+
+    if (b >= e){
+      continue;
+    }
+
+    const Real* grad = it->grad+(b-it->offset);
+    Real* dst = buf+(b-begin);
+
+#pragma omp simd
+    for (long i = 0; i < (long)(e-b); ++i){
+      dst[i] = grad[i];
+    }
+  }
+}
+
+void ParamRegistry::setGrad(const unsigned long begin, const unsigned long end, const Real* buf){
+  assert(this->valid());
+
+  for (auto it = this->view.begin(); it != this->view.end(); ++it){
+    const unsigned long b = std::max(begin, it->offset);
+    const unsigned long e = std::min(end, it->offset+it->rows*it->cols);
+
+    if (b >= e){
+      continue;
+    }
+
+    Real* grad = it->grad+(b-it->offset);
+    const Real* src = buf+(b-begin);
+
+#pragma omp simd
+    for (long i = 0; i < (long)(e-b); ++i){
+      grad[i] = src[i];
+    }
+  }
+}
+
+void ParamRegistry::addGrad(const unsigned long begin, const unsigned long end, const Real* buf){
+  assert(this->valid());
+
+  for (auto it = this->view.begin(); it != this->view.end(); ++it){
+    const unsigned long b = std::max(begin, it->offset);
+    const unsigned long e = std::min(end, it->offset+it->rows*it->cols);
+
+    if (b >= e){
+      continue;
+    }
+
+    Real* grad = it->grad+(b-it->offset);
+    const Real* src = buf+(b-begin);
+
+#pragma omp simd
+    for (long i = 0; i < (long)(e-b); ++i){
+      grad[i] += src[i];
+    }
+  }
+}
+
+void ParamRegistry::update(Optimizer& optimizer, const Real learningRate){
+  std::vector<Optimizer::Moment*> moment(this->view.size());
+
+  assert(this->valid());
+
+  if (optimizer.type == Optimizer::SGD){
+    this->sgd(learningRate);
+    return;
+  }
+
+  //the moments are allocated before the parallel updates
+  for (int i = 0; i < (int)this->view.size(); ++i){
+    moment[i] = &optimizer.moment(this->view[i].name, this->view[i].rows, this->view[i].cols);
+  }
+
+#pragma omp parallel for num_threads(this->numThreads) schedule(static)
+  for (int i = 0; i < (int)this->chunk.size(); ++i){
+    const ParamRegistry::Chunk& c = this->chunk[i];
+    const ParamRegistry::View& v = this->view[c.view];
+
+    optimizer.update(v.grad+c.begin, c.size, learningRate, moment[c.view]->m.data()+c.begin, moment[c.view]->v.data()+c.begin, v.param+c.begin);
+  }
+}
+
+bool ParamRegistry::View::valid() const {
+  if (this->paramMat != 0){
+    return
+      this->paramMat->data() == this->param && this->paramMat->rows() == this->rows && this->paramMat->cols() == this->cols &&
+      this->gradMat->data() == this->grad && this->gradMat->rows() == this->rows && this->gradMat->cols() == this->cols;
+  }
+
+  return
+    this->paramVec->data() == this->param && this->paramVec->rows() == this->rows &&
+    this->gradVec->data() == this->grad && this->gradVec->rows() == this->rows;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Matrix.hpp"
+#include <string>
+#include <vector>
+
+class Optimizer;
+
+//named views of the dense parameters and their gradients, laid out one after another in a flat index space;
+//zeroing, norms, clipping, reduction and updates are single passes over fixed-size chunks of it (in parallel with numThreads);
+//the viewed matrices should not be resized (e.g., by EncDec::quantize), or the registry should be cleared and filled again
+class ParamRegistry{
+public:
+  ParamRegistry(): size(0), numThreads(1) {};
+
+  class View;
+  class Chunk;
+
+  static const int CHUNK_SIZE = 16384;
+
+  std::vector<ParamRegistry::View> view;
+  std::vector<ParamRegistry::Chunk> chunk;
+  unsigned long size; //# of the parameters
+  int numThreads;
+
+  //empty parameters (e.g., unused additional inputs) are skipped
+  void add(const std::string& name, MatD& param, MatD& grad);
+  void add(const std::string& name, VecD& param, VecD& grad);
+  void clear();
+  const ParamRegistry::View* find(const std::string& name) const;
+  //whether all the viewed matrices still have the registered storage (asserted in the passes below)
+  bool valid() const;
+
+  void zero();
+  Real squaredNorm() const;
+  //this = the sum of the gradients of reg (same layout), which are zeroed in the same pass; returns the squared norm of the sum
+  Real reduce(const std::vector<ParamRegistry*>& reg);
+  void sgd(const Real learningRate);
+  //copies between the gradients in [begin, end) of the flat index space and buf (e.g., for the allreduce of ShmRing)
+  void getGrad(const unsigned long begin, const unsigned long end, Real* buf) const;
+  void setGrad(const unsigned long begin, const unsigned long end, const Real* buf);
+  void addGrad(const unsigned long begin, const unsigned long end, const Real* buf);
+  void update(Optimizer& optimizer, const Real learningRate);
+
+private:
+  void add(const ParamRegistry::View& v);
+};
+
+class ParamRegistry::View{
+public:
+  View(const std::string& name_, MatD& param_, MatD& grad_):
+    name(name_), param(param_.data()), grad(grad_.data()), rows(param_.rows()), cols(param_.cols()), offset(0),
+    paramMat(&param_), gradMat(&grad_), paramVec(0), gradVec(0)
+  {};
+  View(const std::string& name_, VecD& param_, VecD& grad_):
+    name(name_), param(param_.data()), grad(grad_.data()), rows(param_.rows()), cols(1), offset(0),
+    paramMat(0), gradMat(0), paramVec(&param_), gradVec(&grad_)
+  {};
+
+  std::string name;
+  Real* param;
+  Real* grad;
+  int rows, cols;
+  unsigned long offset; //in the flat index space
+  //the viewed matrices (or vectors), to detect a resize after add
+  const MatD* paramMat, * gradMat;
+  const VecD* paramVec, * gradVec;
+
+  bool valid() const;
+};
+
+class ParamRegistry::Chunk{
+public:
+  Chunk(const int view_, const int begin_, const int size_):
+    view(view_), begin(begin_), size(size_)
+  {};
+
+  int view;
+  int begin, size; //within the view
+};
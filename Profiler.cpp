@@ -0,0 +1,122 @@
+#include "Profiler.hpp"
+#include <fstream>
+
+std::string Profiler::summaryFile = "n3lp_profile.json";
+std::string Profiler::traceFile = "n3lp_trace.json";
+std::mutex Profiler::mtx;
+std::vector<Profiler::Counter*> Profiler::counters;
+std::chrono::steady_clock::time_point Profiler::origin = std::chrono::steady_clock::now();
+int Profiler::epoch = 0;
+bool Profiler::traceOpened = false;
+unsigned long Profiler::traceEvents = 0;
+long Profiler::traceEnd = 0;
+
+const char* Profiler::name(const Profiler::PHASE phase){
+  static const char* names[Profiler::PHASE_NUM] = {
+    "encode", "decode", "output", "backward", "merge", "sgd", "eval", "search",
+  };
+
+  return names[phase];
+}
+
+Profiler::Counter& Profiler::local(){
+  static thread_local Profiler::Counter* counter = 0;
+
+  if (counter == 0){
+    std::lock_guard<std::mutex> lock(Profiler::mtx);
+
+    counter = new Profiler::Counter(Profiler::counters.size());
+    Profiler::counters.push_back(counter);
+  }
+
+  return *counter;
+}
+
+void Profiler::add(const Profiler::PHASE phase, const unsigned long items,
+		   const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end,
+		   const unsigned long allocs, const unsigned long bytes){
+  Profiler::Counter& counter = Profiler::local();
+  const long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+
+  ++counter.calls[phase];
+  counter.ns[phase] += ns;
+  counter.items[phase] += items;
+  counter.allocs[phase] += allocs;
+  counter.bytes[phase] += bytes;
+
+  if (Profiler::traceFile != ""){
+    counter.event.push_back(Profiler::Event(phase, std::chrono::duration_cast<std::chrono::microseconds>(start-Profiler::origin).count(), ns/1000));
+  }
+}
+
+void Profiler::flush(){
+  std::lock_guard<std::mutex> lock(Profiler::mtx);
+  unsigned long calls[Profiler::PHASE_NUM] = {}, ns[Profiler::PHASE_NUM] = {}, items[Profiler::PHASE_NUM] = {};
+  unsigned long allocs[Profiler::PHASE_NUM] = {}, bytes[Profiler::PHASE_NUM] = {};
+  unsigned long total = 0;
+  int threads = 0;
+
+  for (auto it = Profiler::counters.begin(); it != Profiler::counters.end(); ++it){
+    bool active = false;
+
+    for (int i = 0; i < Profiler::PHASE_NUM; ++i){
+      calls[i] += (*it)->calls[i];
+      ns[i] += (*it)->ns[i];
+      items[i] += (*it)->items[i];
+      allocs[i] += (*it)->allocs[i];
+      bytes[i] += (*it)->bytes[i];
+      active = active || (*it)->calls[i] > 0;
+    }
+
+    threads += (active ? 1 : 0);
+  }
+
+  for (int i = 0; i < Profiler::PHASE_NUM; ++i){
+    total += ns[i];
+  }
+
+  ++Profiler::epoch;
+
+  if (Profiler::summaryFile != ""){
+    std::ofstream ofs(Profiler::summaryFile.c_str(), std::ios::app);
+
+    //the times are summed over the threads; the allocations per call are per training step (sentence) or decoded sentence
+    ofs << "{\"epoch\": " << Profiler::epoch << ", \"threads\": " << threads << ", \"sec\": " << total*1.0e-09
+	<< ", \"alloc_tracking\": " << (AllocTracker::enabled() ? "true" : "false") << ", \"phases\": {";
+    for (int i = 0; i < Profiler::PHASE_NUM; ++i){
+      ofs << (i ? ", " : "") << "\"" << Profiler::name((Profiler::PHASE)i) << "\": {\"calls\": " << calls[i]
+	  << ", \"sec\": " << ns[i]*1.0e-09 << ", \"share\": " << (total ? (double)ns[i]/total : 0.0) << ", \"items\": " << items[i]
+	  << ", \"allocs\": " << allocs[i] << ", \"bytes\": " << bytes[i]
+	  << ", \"allocs_per_call\": " << (calls[i] ? (double)allocs[i]/calls[i] : 0.0) << ", \"bytes_per_call\": " << (calls[i] ? (double)bytes[i]/calls[i] : 0.0) << "}";
+    }
+    ofs << "}}" << std::endl;
+  }
+
+  //JSON array, closed at each flush; the events of the next epoch are written over the closing bracket
+  if (Profiler::traceFile != ""){
+    std::fstream fs(Profiler::traceFile.c_str(), (Profiler::traceOpened ? std::ios::in|std::ios::out : std::ios::out|std::ios::trunc));
+
+    if (!Profiler::traceOpened){
+      fs << "[";
+      Profiler::traceOpened = true;
+    }
+    else {
+      fs.seekp(Profiler::traceEnd);
+    }
+
+    for (auto it = Profiler::counters.begin(); it != Profiler::counters.end(); ++it){
+      for (auto e = (*it)->event.begin(); e != (*it)->event.end(); ++e){
+	fs << (Profiler::traceEvents++ > 0 ? "," : "") << std::endl
+	   << "{\"name\": \"" << Profiler::name(e->phase) << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << (*it)->tid
+	   << ", \"ts\": " << e->ts << ", \"dur\": " << e->dur << "}";
+      }
+    }
+
+    Profiler::traceEnd = fs.tellp();
+    fs << std::endl << "]" << std::endl;
+  }
+
+  for (auto it = Profiler::counters.begin(); it != Profiler::counters.end(); ++it){
+    (*it)->clear();
+  }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "AllocTracker.hpp"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+//per-phase timers and counters of training and translation;
+//the hooks are compiled out unless N3LP_PROFILE (or N3LP_ALLOC_TRACK, to count the allocations as well) is defined (see Makefile)
+class Profiler{
+public:
+  enum PHASE{
+    ENCODE,
+    DECODE, //decoder forward (and attention)
+    OUTPUT, //softmax/blackout forward and backward
+    BACKWARD, //decoder, attention and encoder backward
+    MERGE, //summing the per-thread gradients
+    SGD,
+    EVAL,
+    SEARCH, //decoding a sentence (greedy or beam search)
+    PHASE_NUM,
+  };
+
+  class Counter;
+  class Event;
+  class Scope;
+
+  static std::string summaryFile; //one JSON object per flush (training epoch or translated file)
+  static std::string traceFile; //Chrome trace (chrome://tracing); empty: not recorded
+
+  static const char* name(const Profiler::PHASE phase);
+  static Profiler::Counter& local();
+  static void add(const Profiler::PHASE phase, const unsigned long items,
+		  const std::chrono::steady_clock::time_point& start, const std::chrono::steady_clock::time_point& end,
+		  const unsigned long allocs, const unsigned long bytes);
+  //aggregates the counters of all the threads, writes them and resets them (called between parallel regions)
+  static void flush();
+
+private:
+  static std::mutex mtx;
+  static std::vector<Profiler::Counter*> counters;
+  static std::chrono::steady_clock::time_point origin;
+  static int epoch;
+  static bool traceOpened;
+  static unsigned long traceEvents; //# of the events written
+  static long traceEnd; //the position of the closing bracket, overwritten by the next events
+};
+
+class Profiler::Event{
+public:
+  Event(const Profiler::PHASE phase_, const long ts_, const long dur_):
+    phase(phase_), ts(ts_), dur(dur_)
+  {};
+
+  Profiler::PHASE phase;
+  long ts, dur; //in micro seconds
+};
+
+//thread-local; registered at the first use in each thread
+class Profiler::Counter{
+public:
+  Counter(const int tid_): tid(tid_){
+    this->clear();
+  };
+
+  int tid;
+  unsigned long calls[Profiler::PHASE_NUM];
+  unsigned long ns[Profiler::PHASE_NUM];
+  unsigned long items[Profiler::PHASE_NUM]; //e.g., # of tokens processed
+  unsigned long allocs[Profiler::PHASE_NUM]; //0 unless the allocation hooks are installed
+  unsigned long bytes[Profiler::PHASE_NUM];
+  std::vector<Profiler::Event> event;
+
+  void clear(){
+    for (int i = 0; i < Profiler::PHASE_NUM; ++i){
+      this->calls[i] = this->ns[i] = this->items[i] = this->allocs[i] = this->bytes[i] = 0;
+    }
+    this->event.clear();
+  };
+};
+
+class Profiler::Scope{
+public:
+  Scope(const Profiler::PHASE phase_, const unsigned long items_ = 0):
+    phase(phase_), items(items_), start(std::chrono::steady_clock::now()), allocs(AllocTracker::count), bytes(AllocTracker::bytes)
+  {};
+  ~Scope(){
+    Profiler::add(this->phase, this->items, this->start, std::chrono::steady_clock::now(),
+		  AllocTracker::count-this->allocs, AllocTracker::bytes-this->bytes);
+  };
+
+  Profiler::PHASE phase;
+  unsigned long items;
+  std::chrono::steady_clock::time_point start;
+  unsigned long allocs, bytes; //the thread-local counts at the start
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if defined(N3LP_ALLOC_TRACK) && !defined(N3LP_PROFILE)
+#define N3LP_PROFILE
+#endif
+
+#ifdef N3LP_PROFILE
+#define PROFILE_SCOPE(phase, items) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(phase, items)
+#define PROFILE_FLUSH() Profiler::flush()
+#else
+#define PROFILE_SCOPE(phase, items)
+#define PROFILE_FLUSH()
+#endif
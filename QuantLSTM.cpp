@@ -0,0 +1,125 @@
+#include "QuantLSTM.hpp"
+#include "LSTM.hpp"
+#include "ActFunc.hpp"
+#include "Utils.hpp"
+#include <iostream>
+#include <cstdlib>
+
+thread_local QuantVec QuantLSTM::x;
+thread_local QuantVec QuantLSTM::h;
+thread_local VecD QuantLSTM::gate;
+
+static void unsupported(const char* name){
+  std::cerr << "QuantLSTM::" << name << " is not supported (the int8 model is for the inference only)" << std::endl;
+  exit(1);
+}
+
+QuantLSTM::QuantLSTM(const LSTM& lstm){
+  const int H = lstm.bi.rows();
+  MatD Wx(4*H, lstm.Wxi.cols()), Wh(4*H, H);
+
+  Wx << lstm.Wxi, lstm.Wxf, lstm.Wxo, lstm.Wxu;
+  Wh << lstm.Whi, lstm.Whf, lstm.Who, lstm.Whu;
+  this->b.resize(4*H);
+  this->b << lstm.bi, lstm.bf, lstm.bo, lstm.bu;
+  this->Wx.quantize(Wx);
+  this->Wh.quantize(Wh);
+}
+
+unsigned long QuantLSTM::bytes() const {
+  return this->Wx.bytes()+this->Wh.bytes()+sizeof(Real)*this->b.rows();
+}
+
+RNN::State* QuantLSTM::newState() const {
+  return new LSTM::State;
+}
+
+RNN::Grad* QuantLSTM::newGrad() const {
+  return 0;
+}
+
+int QuantLSTM::stateDim() const {
+  return this->b.rows()/2;
+}
+
+void QuantLSTM::getState(const RNN::State* s, VecD& v) const {
+  const LSTM::State* state = (const LSTM::State*)s;
+  const int H = this->b.rows()/4;
+
+  v.resize(2*H);
+  v.head(H) = state->h;
+  v.tail(H) = state->c;
+}
+
+void QuantLSTM::setState(const VecD& v, RNN::State* s) const {
+  LSTM::State* state = (LSTM::State*)s;
+  const int H = this->b.rows()/4;
+
+  state->h = v.head(H);
+  state->c = v.tail(H);
+}
+
+void QuantLSTM::getStateGrad(const RNN::State*, VecD&) const {
+  unsupported("getStateGrad");
+}
+
+void QuantLSTM::setStateGrad(const VecD&, RNN::State*) const {
+  unsupported("setStateGrad");
+}
+
+//the gates are computed by two integer GEMVs with the stacked weights
+void QuantLSTM::forward(const VecD& xt, const RNN::State* prev_, RNN::State* cur_){
+  const LSTM::State* prev = (const LSTM::State*)prev_;
+  LSTM::State* cur = (LSTM::State*)cur_;
+  const int H = this->b.rows()/4;
+
+  QuantLSTM::gate = this->b;
+  QuantLSTM::x.quantize(xt, this->Wx.stride);
+  QuantLSTM::h.quantize(prev->h, this->Wh.stride);
+  this->Wx.gemv(QuantLSTM::x, QuantLSTM::gate);
+  this->Wh.gemv(QuantLSTM::h, QuantLSTM::gate);
+
+  cur->i = QuantLSTM::gate.segment(0, H);
+  cur->f = QuantLSTM::gate.segment(H, H);
+  cur->o = QuantLSTM::gate.segment(2*H, H);
+  cur->u = QuantLSTM::gate.segment(3*H, H);
+  ActFunc::logistic(cur->i);
+  ActFunc::logistic(cur->f);
+  ActFunc::logistic(cur->o);
+  ActFunc::tanh(cur->u);
+  cur->c = cur->i.array()*cur->u.array() + cur->f.array()*prev->c.array();
+  cur->cTanh = cur->c;
+  ActFunc::tanh(cur->cTanh);
+  cur->h = cur->o.array()*cur->cTanh.array();
+}
+
+void QuantLSTM::forwardSeq(const MatD& xs, std::vector<RNN::State*>& state){
+  for (int t = 0; t < xs.cols(); ++t){
+    this->forward(xs.col(t), state[t], state[t+1]);
+  }
+}
+
+void QuantLSTM::backwardSeq(const MatD&, std::vector<RNN::State*>&, RNN::Grad&){
+  unsupported("backwardSeq");
+}
+
+void QuantLSTM::sgd(const RNN::Grad&, const Real){
+  unsupported("sgd");
+}
+
+void QuantLSTM::registerParams(RNN::Grad&, const std::string&, ParamRegistry&){
+  unsupported("registerParams");
+}
+
+void QuantLSTM::save(std::ofstream& ofs){
+  this->Wx.save(ofs);
+  this->Wh.save(ofs);
+  Utils::save(ofs, this->b);
+}
+
+void QuantLSTM::load(std::ifstream& ifs){
+  this->Wx.load(ifs);
+  this->Wh.load(ifs);
+  this->b.resize(this->Wx.rows);
+  Utils::load(ifs, this->b);
+}
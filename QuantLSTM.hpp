@@ -0,0 +1,38 @@
+#pragma once
+
+#include "RNN.hpp"
+#include "QuantMat.hpp"
+
+class LSTM;
+
+//inference-only LSTM with the int8 weights of a trained one (see EncDec::quantize); the states are LSTM::State,
+//and the input and the previous h are quantized at each step; the training part of RNN is not supported
+class QuantLSTM : public RNN{
+public:
+  QuantLSTM(){};
+  QuantLSTM(const LSTM& lstm);
+
+  QuantMat Wx, Wh; //[Wxi; Wxf; Wxo; Wxu] and [Whi; Whf; Who; Whu]
+  VecD b; //[bi; bf; bo; bu]
+
+  //the quantized input and h, and the gates, reused across the steps; per thread, as the translation threads share the model
+  static thread_local QuantVec x, h;
+  static thread_local VecD gate;
+
+  unsigned long bytes() const;
+
+  RNN::State* newState() const;
+  RNN::Grad* newGrad() const;
+  int stateDim() const;
+  void getState(const RNN::State* s, VecD& v) const;
+  void setState(const VecD& v, RNN::State* s) const;
+  void getStateGrad(const RNN::State* s, VecD& v) const;
+  void setStateGrad(const VecD& v, RNN::State* s) const;
+  void forward(const VecD& xt, const RNN::State* prev, RNN::State* cur);
+  void forwardSeq(const MatD& xs, std::vector<RNN::State*>& state);
+  void backwardSeq(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad);
+  void sgd(const RNN::Grad& grad, const Real learningRate);
+  void registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg);
+  void save(std::ofstream& ofs);
+  void load(std::ifstream& ifs);
+};
@@ -0,0 +1,147 @@
+#include "QuantMat.hpp"
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+void QuantMat::quantizeRow(const int i, const Real* v, const int inc){
+  signed char* q = &this->data[(unsigned long)i*this->stride];
+  Real absMax = 0.0;
+
+  for (int j = 0; j < this->cols; ++j){
+    absMax = std::max(absMax, std::fabs(v[j*inc]));
+  }
+
+  this->scale[i] = (absMax > 0.0 ? absMax/127.0 : 1.0);
+
+  for (int j = 0; j < this->cols; ++j){
+    q[j] = (signed char)std::lrint(v[j*inc]/this->scale[i]);
+  }
+}
+
+void QuantMat::quantize(const MatD& m){
+  this->rows = m.rows();
+  this->cols = m.cols();
+  this->stride = (this->cols+QuantMat::ALIGN-1)/QuantMat::ALIGN*QuantMat::ALIGN;
+  this->data.assign((unsigned long)this->rows*this->stride, 0);
+  this->scale.resize(this->rows);
+
+  //the coefficients of a row are m.rows() apart in the column-major storage
+  for (int i = 0; i < this->rows; ++i){
+    this->quantizeRow(i, m.data()+i, m.rows());
+  }
+}
+
+void QuantMat::quantizeCols(const MatD& m){
+  this->rows = m.cols();
+  this->cols = m.rows();
+  this->stride = (this->cols+QuantMat::ALIGN-1)/QuantMat::ALIGN*QuantMat::ALIGN;
+  this->data.assign((unsigned long)this->rows*this->stride, 0);
+  this->scale.resize(this->rows);
+
+  for (int i = 0; i < this->rows; ++i){
+    this->quantizeRow(i, m.data()+(unsigned long)i*m.rows(), 1);
+  }
+}
+
+void QuantMat::gemv(const QuantVec& x, VecD& y) const {
+  const signed char* q = &this->data[0];
+
+  for (int i = 0; i < this->rows; ++i, q += this->stride){
+    y.coeffRef(i, 0) += this->scale[i]*x.scale*QuantMat::dot(q, &x.data[0], this->stride);
+  }
+}
+
+void QuantMat::row(const int i, Real* v) const {
+  const signed char* q = &this->data[(unsigned long)i*this->stride];
+
+  for (int j = 0; j < this->cols; ++j){
+    v[j] = this->scale[i]*q[j];
+  }
+}
+
+unsigned long QuantMat::bytes() const {
+  return this->data.size()+sizeof(Real)*this->scale.size();
+}
+
+void QuantMat::save(std::ofstream& ofs) const {
+  ofs.write((char*)&this->rows, sizeof(int));
+  ofs.write((char*)&this->cols, sizeof(int));
+  ofs.write((char*)&this->scale[0], sizeof(Real)*this->rows);
+
+  for (int i = 0; i < this->rows; ++i){
+    ofs.write((char*)&this->data[(unsigned long)i*this->stride], this->cols);
+  }
+}
+
+void QuantMat::load(std::ifstream& ifs){
+  ifs.read((char*)&this->rows, sizeof(int));
+  ifs.read((char*)&this->cols, sizeof(int));
+  this->stride = (this->cols+QuantMat::ALIGN-1)/QuantMat::ALIGN*QuantMat::ALIGN;
+  this->data.assign((unsigned long)this->rows*this->stride, 0);
+  this->scale.resize(this->rows);
+  ifs.read((char*)&this->scale[0], sizeof(Real)*this->rows);
+
+  for (int i = 0; i < this->rows; ++i){
+    ifs.read((char*)&this->data[(unsigned long)i*this->stride], this->cols);
+  }
+}
+
+//u8 x s8 products (as in VNNI): |b| is the unsigned operand and the sign of b is moved to a,
+//which is exact as both are in [-127, 127] (and the pairs of maddubs do not saturate: 2*127*127 < 2^15)
+int QuantMat::dot(const signed char* a, const signed char* b, const int n){
+#if defined(__AVX2__)
+  __m256i acc = _mm256_setzero_si256();
+#if !(defined(__AVX512VNNI__) && defined(__AVX512VL__))
+  const __m256i ones = _mm256_set1_epi16(1);
+#endif
+
+  for (int k = 0; k < n; k += QuantMat::ALIGN){
+    const __m256i va = _mm256_loadu_si256((const __m256i*)(a+k));
+    const __m256i vb = _mm256_loadu_si256((const __m256i*)(b+k));
+    const __m256i absB = _mm256_sign_epi8(vb, vb);
+    const __m256i signA = _mm256_sign_epi8(va, vb);
+
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    acc = _mm256_dpbusd_epi32(acc, absB, signA);
+#else
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(absB, signA), ones));
+#endif
+  }
+
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum);
+#else
+  int res = 0;
+
+  for (int k = 0; k < n; ++k){
+    res += (int)a[k]*(int)b[k];
+  }
+
+  return res;
+#endif
+}
+
+const char* QuantMat::kernel(){
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+  return "avx512vnni";
+#elif defined(__AVX2__)
+  return "avx2";
+#else
+  return "scalar";
+#endif
+}
+
+void QuantVec::quantize(const VecD& v, const int stride){
+  const Real absMax = (v.rows() > 0 ? v.array().abs().maxCoeff() : 0.0);
+
+  this->scale = (absMax > 0.0 ? absMax/127.0 : 1.0);
+  this->data.assign(stride, 0);
+
+  for (int j = 0; j < v.rows(); ++j){
+    this->data[j] = (signed char)std::lrint(v.coeff(j, 0)/this->scale);
+  }
+}
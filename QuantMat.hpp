@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Matrix.hpp"
+#include <vector>
+#include <fstream>
+
+class QuantVec;
+
+//int8 matrix with a scale per row (symmetric: w = scale*q with q in [-127, 127]) for the quantized inference (see EncDec::quantize);
+//each row is contiguous and zero-padded to a multiple of QuantMat::ALIGN, so y = W*x is an integer dot product per row,
+//and a row can also be an embedding or an output word (see quantizeCols)
+class QuantMat{
+public:
+  QuantMat(): rows(0), cols(0), stride(0) {};
+
+  static const int ALIGN = 32;
+
+  int rows, cols, stride;
+  std::vector<signed char> data; //rows x stride
+  std::vector<Real> scale;
+
+  //quantizes each row of m (quantizeCols: each column, e.g., for the embeddings and the output layer)
+  void quantize(const MatD& m);
+  void quantizeCols(const MatD& m);
+  //y += W*x
+  void gemv(const QuantVec& x, VecD& y) const;
+  //the dequantized i-th row (cols values)
+  void row(const int i, Real* v) const;
+  unsigned long bytes() const;
+  void save(std::ofstream& ofs) const;
+  void load(std::ifstream& ifs);
+
+  //n should be a multiple of ALIGN; the values are in [-127, 127]
+  static int dot(const signed char* a, const signed char* b, const int n);
+  //the dot product kernel selected at compile time (e.g., "avx512vnni")
+  static const char* kernel();
+
+private:
+  void quantizeRow(const int i, const Real* v, const int inc);
+};
+
+//int8 vector with a single scale, quantized on the fly (e.g., the input and the hidden state of QuantLSTM)
+class QuantVec{
+public:
+  QuantVec(): scale(0.0) {};
+
+  std::vector<signed char> data; //padded with zeros to the stride of the matrix
+  Real scale;
+
+  void quantize(const VecD& v, const int stride);
+};
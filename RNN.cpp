@@ -0,0 +1,15 @@
+#include "RNN.hpp"
+
+void RNN::forwardCheckpoint(const MatD& xs, std::vector<RNN::State*>& state, const int, MatD& hs){
+  this->forwardSeq(xs, state);
+  hs.resize(state[0]->h.rows(), xs.cols()+1);
+
+  for (int t = 0; t <= xs.cols(); ++t){
+    hs.col(t) = state[t]->h;
+  }
+}
+
+unsigned long RNN::backwardCheckpoint(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad, const int){
+  this->backwardSeq(xs, state, grad);
+  return 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Matrix.hpp"
+#include "Rand.hpp"
+#include <fstream>
+#include <vector>
+#include <string>
+
+class ParamRegistry;
+
+//interface of the recurrent units (LSTM, LnLSTM, GRU and DeepLSTM) used by EncDec;
+//for whole sequences, state[0] is the initial state and state[t+1] corresponds to xs.col(t)
+class RNN{
+public:
+  virtual ~RNN(){};
+
+  class State;
+  class Grad;
+
+  virtual RNN::State* newState() const = 0;
+  virtual RNN::Grad* newGrad() const = 0;
+
+  //the recurrent state (e.g., [h; c] of LSTM) as a vector, to initialize, combine and cache the states
+  virtual int stateDim() const = 0;
+  virtual void getState(const RNN::State* s, VecD& v) const = 0;
+  virtual void setState(const VecD& v, RNN::State* s) const = 0;
+  //gradient w.r.t. the recurrent state; setStateGrad is called for the last state after its delh (the gradient of the output) is set,
+  //and adds the part of the output h to delh and sets the other parts (e.g., c)
+  virtual void getStateGrad(const RNN::State* s, VecD& v) const = 0;
+  virtual void setStateGrad(const VecD& v, RNN::State* s) const = 0;
+
+  virtual void forward(const VecD& xt, const RNN::State* prev, RNN::State* cur) = 0;
+  virtual void forwardSeq(const MatD& xs, std::vector<RNN::State*>& state) = 0;
+  //delh of all the states should be initialized, and setStateGrad should be called for the last state
+  virtual void backwardSeq(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad) = 0;
+
+  //gradient checkpointing (see LSTM::forwardCheckpoint): hs.col(t) is h of state[t], and backward returns the max # of bytes
+  //recomputed at once; by default, all the states are kept until backward
+  virtual void forwardCheckpoint(const MatD& xs, std::vector<RNN::State*>& state, const int k, MatD& hs);
+  virtual unsigned long backwardCheckpoint(const MatD& xs, std::vector<RNN::State*>& state, RNN::Grad& grad, const int k);
+
+  virtual void sgd(const RNN::Grad& grad, const Real learningRate) = 0;
+  //adds the parameters and their gradients to the registry, with the names prefixed
+  virtual void registerParams(RNN::Grad& grad, const std::string& prefix, ParamRegistry& reg) = 0;
+  virtual void save(std::ofstream& ofs) = 0;
+  virtual void load(std::ifstream& ifs) = 0;
+};
+
+class RNN::State{
+public:
+  virtual ~State(){};
+
+  VecD h; //output
+
+  VecD delh, delx; //for backprop
+
+  virtual void clear() = 0;
+  virtual unsigned long bytes() = 0;
+};
+
+class RNN::Grad{
+public:
+  virtual ~Grad(){};
+
+  virtual void init() = 0;
+  virtual Real norm() = 0;
+};
@@ -0,0 +1,256 @@
+#include "RNNLM.hpp"
+#include "Utils.hpp"
+#include <iostream>
+#include <fstream>
+#include <sys/time.h>
+
+RNNLM::RNNLM(Vocabulary& voc_, const int inputDim, const int hiddenDim, const int depth, const int window_):
+  voc(voc_), window(window_)
+{
+  const Real scale = 0.1;
+
+  this->lstm = DeepLSTM(inputDim, hiddenDim, depth);
+  this->lstm.init(this->rnd, scale);
+  this->softmax = SoftMax(hiddenDim, this->voc.tokenList.size());
+  this->embed = MatD(inputDim, this->voc.tokenList.size());
+  this->rnd.uniform(this->embed, scale);
+  this->zeros = VecD::Zero(hiddenDim);
+
+  //Bias 1
+  for (auto it = this->lstm.lstms.begin(); it != this->lstm.lstms.end(); ++it){
+    it->bf.fill(1.0);
+  }
+
+  //only window+1 states are kept, however long the stream is
+  for (int i = 0; i <= this->window; ++i){
+    this->state.push_back(new DeepLSTM::State(this->lstm));
+  }
+
+  this->reset();
+}
+
+RNNLM::~RNNLM(){
+  for (auto it = this->state.begin(); it != this->state.end(); ++it){
+    delete *it;
+  }
+}
+
+void RNNLM::reset(){
+  for (auto it = this->state[0]->lstm.begin(); it != this->state[0]->lstm.end(); ++it){
+    (*it)->h = this->zeros;
+    (*it)->c = this->zeros;
+  }
+}
+
+//the next window starts from state[length]; no gradient flows across windows
+void RNNLM::carry(const int length){
+  for (int i = 0; i < (int)this->lstm.lstms.size(); ++i){
+    this->state[0]->lstm[i]->h = this->state[length]->lstm[i]->h;
+    this->state[0]->lstm[i]->c = this->state[length]->lstm[i]->c;
+  }
+}
+
+//token[0], ..., token[T-1] are the inputs and token[1], ..., token[T] are the outputs
+void RNNLM::forward(const std::vector<int>& token, MatD& xs, std::vector<DeepLSTM::State*>& seq){
+  const int T = token.size()-1;
+
+  xs.resize(this->embed.rows(), T);
+
+  for (int t = 0; t < T; ++t){
+    xs.col(t) = this->embed.col(token[t]);
+  }
+
+  seq.assign(this->state.begin(), this->state.begin()+T+1);
+  this->lstm.forwardSeq(xs, seq);
+}
+
+Real RNNLM::train(const std::vector<int>& token, RNNLM::Grad& grad, const Real learningRate){
+  const int T = token.size()-1;
+  const Real clipThreshold = 3.0;
+  std::vector<DeepLSTM::State*> seq;
+  VecD dist;
+  MatD xs;
+  Real loss = 0.0, gradNorm, lr;
+
+  this->forward(token, xs, seq);
+
+  for (int t = 0; t <= T; ++t){
+    for (auto it = seq[t]->lstm.begin(); it != seq[t]->lstm.end(); ++it){
+      (*it)->delh = this->zeros;
+      (*it)->delc = this->zeros;
+    }
+  }
+
+  for (int t = 1; t <= T; ++t){
+    this->softmax.calcDist(seq[t]->lstm.back()->h, dist);
+    loss += this->softmax.calcLoss(dist, token[t]);
+    this->softmax.backward(seq[t]->lstm.back()->h, dist, token[t], seq[t]->lstm.back()->delh, grad.softmaxGrad);
+  }
+
+  this->lstm.backwardSeq(xs, seq, grad.lstmGrad);
+
+  for (int t = 1; t <= T; ++t){
+    if (grad.embed.count(token[t-1])){
+      grad.embed.at(token[t-1]) += seq[t]->lstm[0]->delx;
+    }
+    else {
+      grad.embed[token[t-1]] = seq[t]->lstm[0]->delx;
+    }
+  }
+
+  gradNorm = sqrt(grad.norm());
+  Utils::infNan(gradNorm);
+  lr = (gradNorm > clipThreshold ? clipThreshold*learningRate/gradNorm : learningRate);
+
+  this->lstm.sgd(grad.lstmGrad, lr);
+  this->softmax.sgd(grad.softmaxGrad, lr);
+
+  for (auto it = grad.embed.begin(); it != grad.embed.end(); ++it){
+    this->embed.col(it->first) -= lr*it->second;
+  }
+
+  grad.init();
+  this->carry(T);
+
+  return loss;
+}
+
+Real RNNLM::calcLoss(const std::vector<int>& token){
+  const int T = token.size()-1;
+  std::vector<DeepLSTM::State*> seq;
+  VecD dist;
+  MatD xs;
+  Real loss = 0.0;
+
+  this->forward(token, xs, seq);
+
+  for (int t = 1; t <= T; ++t){
+    this->softmax.calcDist(seq[t]->lstm.back()->h, dist);
+    loss += this->softmax.calcLoss(dist, token[t]);
+  }
+
+  this->carry(T);
+
+  return loss;
+}
+
+//the file is read as one stream (with EOS at the end of each line) and processed window by window
+Real RNNLM::train(const std::string& file, const Real learningRate){
+  std::ifstream ifs(file.c_str());
+  std::vector<std::string> tokens;
+  std::vector<int> token(1, this->voc.eosIndex), line;
+  RNNLM::Grad grad(*this);
+  Real loss = 0.0;
+  int count = 0;
+
+  this->reset();
+
+  for (std::string str; std::getline(ifs, str); ){
+    Utils::split(str, tokens);
+    line.clear();
+
+    for (auto it = tokens.begin(); it != tokens.end(); ++it){
+      line.push_back(this->voc.tokenIndex.count(*it) ? this->voc.tokenIndex.at(*it) : this->voc.unkIndex);
+    }
+
+    line.push_back(this->voc.eosIndex);
+
+    for (auto it = line.begin(); it != line.end(); ++it){
+      token.push_back(*it);
+
+      if ((int)token.size() == this->window+1){
+	loss += this->train(token, grad, learningRate);
+	count += this->window;
+	token.assign(1, token.back());
+      }
+    }
+  }
+
+  if (token.size() > 1){
+    loss += this->train(token, grad, learningRate);
+    count += token.size()-1;
+  }
+
+  return loss/count;
+}
+
+Real RNNLM::calcPerplexity(const std::string& file){
+  std::ifstream ifs(file.c_str());
+  std::vector<std::string> tokens;
+  std::vector<int> token(1, this->voc.eosIndex), line;
+  Real loss = 0.0;
+  int count = 0;
+
+  this->reset();
+
+  for (std::string str; std::getline(ifs, str); ){
+    Utils::split(str, tokens);
+    line.clear();
+
+    for (auto it = tokens.begin(); it != tokens.end(); ++it){
+      line.push_back(this->voc.tokenIndex.count(*it) ? this->voc.tokenIndex.at(*it) : this->voc.unkIndex);
+    }
+
+    line.push_back(this->voc.eosIndex);
+
+    for (auto it = line.begin(); it != line.end(); ++it){
+      token.push_back(*it);
+
+      if ((int)token.size() == this->window+1){
+	loss += this->calcLoss(token);
+	count += this->window;
+	token.assign(1, token.back());
+      }
+    }
+  }
+
+  if (token.size() > 1){
+    loss += this->calcLoss(token);
+    count += token.size()-1;
+  }
+
+  return exp(loss/count);
+}
+
+void RNNLM::save(const std::string& fileName){
+  std::ofstream ofs(fileName.c_str(), std::ios::out|std::ios::binary);
+
+  assert(ofs);
+
+  this->lstm.save(ofs);
+  this->softmax.save(ofs);
+  Utils::save(ofs, this->embed);
+}
+
+void RNNLM::load(const std::string& fileName){
+  std::ifstream ifs(fileName.c_str(), std::ios::in|std::ios::binary);
+
+  assert(ifs);
+
+  this->lstm.load(ifs);
+  this->softmax.load(ifs);
+  Utils::load(ifs, this->embed);
+}
+
+void RNNLM::demo(const std::string& train, const std::string& dev, const int window){
+  const int threshold = 1;
+  Vocabulary voc(train, threshold);
+  const Real learningRate = 0.5;
+  const int inputDim = 100;
+  const int hiddenDim = 100;
+  const int depth = 2;
+  RNNLM rnnlm(voc, inputDim, hiddenDim, depth, window);
+  struct timeval start, end;
+
+  std::cout << "Voc size: " << voc.tokenIndex.size() << std::endl;
+  std::cout << "BPTT window: " << window << " steps" << std::endl;
+
+  for (int i = 0; i < 20; ++i){
+    std::cout << "\nEpoch " << i+1 << std::endl;
+    gettimeofday(&start, 0);
+    std::cout << "Training loss (/token): " << rnnlm.train(train, learningRate) << std::endl;
+    gettimeofday(&end, 0);
+    std::cout << "Training time for this epoch: " << (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06 << " sec." << std::endl;
+    std::cout << "Development perplexity: " << rnnlm.calcPerplexity(dev) << std::endl;
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "DeepLSTM.hpp"
+#include "Vocabulary.hpp"
+#include "SoftMax.hpp"
+#include <unordered_map>
+
+//LSTM language model trained with truncated BPTT over a token stream
+class RNNLM{
+public:
+  RNNLM(Vocabulary& voc_, const int inputDim, const int hiddenDim, const int depth, const int window_);
+  ~RNNLM();
+
+  class Grad;
+
+  Rand rnd;
+  Vocabulary& voc;
+  DeepLSTM lstm;
+  SoftMax softmax;
+  MatD embed;
+  VecD zeros;
+  int window; //# of time steps to backpropagate through
+  std::vector<DeepLSTM::State*> state; //state[0] carries the last state of the previous window
+
+  void reset();
+  void carry(const int length);
+  void forward(const std::vector<int>& token, MatD& xs, std::vector<DeepLSTM::State*>& seq);
+  Real train(const std::vector<int>& token, RNNLM::Grad& grad, const Real learningRate);
+  Real train(const std::string& file, const Real learningRate);
+  Real calcLoss(const std::vector<int>& token);
+  Real calcPerplexity(const std::string& file);
+  void save(const std::string& fileName);
+  void load(const std::string& fileName);
+  static void demo(const std::string& train, const std::string& dev, const int window);
+};
+
+class RNNLM::Grad{
+public:
+  Grad(const RNNLM& rnnlm):
+    lstmGrad(rnnlm.lstm), softmaxGrad(rnnlm.softmax)
+  {}
+
+  DeepLSTM::Grad lstmGrad;
+  SoftMax::Grad softmaxGrad;
+  std::unordered_map<int, VecD> embed;
+
+  void init(){
+    this->lstmGrad.init();
+    this->softmaxGrad.init();
+    this->embed.clear();
+  }
+
+  Real norm(){
+    Real res = this->lstmGrad.norm()+this->softmaxGrad.norm();
+
+    for (auto it = this->embed.begin(); it != this->embed.end(); ++it){
+      res += it->second.squaredNorm();
+    }
+
+    return res;
+  }
+};
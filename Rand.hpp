@@ -12,6 +12,8 @@ public:
 
   unsigned long next();
   Real zero2one();
+  //uniform in (0, 1) with 53 bits from two outputs (zero2one has 16 bits only), e.g., for the inverse CDF of a long tail
+  Real zero2one53();
   void uniform(MatD& mat, const Real scale = 1.0);
   void uniform(VecD& vec, const Real scale = 1.0);
   Real gauss(Real sigma, Real mu = 0.0);
@@ -39,6 +41,13 @@ inline Real Rand::zero2one(){
   return ((this->next()&0xFFFF)+1)/65536.0;
 }
 
+inline Real Rand::zero2one53(){
+  const unsigned long hi = this->next()&0x3FFFFFF; //26 bits
+  const unsigned long lo = this->next()&0x7FFFFFF; //27 bits
+
+  return ((hi<<27)+lo+0.5)/9007199254740992.0; //2^53
+}
+
 inline void Rand::uniform(MatD& mat, const Real scale){
   for (int i = 0; i < mat.rows(); ++i){
     for (int j = 0; j < mat.cols(); ++j){
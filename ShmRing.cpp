@@ -0,0 +1,187 @@
+#include "ShmRing.hpp"
+#include "ParamRegistry.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+ShmRing::~ShmRing(){
+  if (this->base != 0){
+    munmap(this->base, this->bytes);
+  }
+
+  if (this->fd >= 0){
+    close(this->fd);
+
+    if (this->rank == 0){
+      unlink(("/dev/shm/"+this->name).c_str());
+    }
+  }
+}
+
+bool ShmRing::open(const unsigned long denseSize, const unsigned long rowCapacity_){
+  const std::string path = "/dev/shm/"+this->name;
+
+  this->rowCapacity = rowCapacity_;
+  this->slotSize = (denseSize+this->size-1)/this->size;
+  this->bytes = ShmRing::HEADER_BYTES+sizeof(Real)*(2*this->size*this->slotSize+this->size*this->rowCapacity);
+
+  if (this->rank == 0){
+    ShmRing::removeStale(path);
+    this->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (this->fd < 0 || ftruncate(this->fd, this->bytes) != 0 || !this->map(path)){
+      std::cerr << "Failed to open " << path << ": " << strerror(errno) << std::endl;
+      return false;
+    }
+
+    //all the processes have mapped the segment after this
+    while (this->header->joined.load() < this->size-1){
+      sched_yield();
+    }
+
+    this->header->ready.store(1);
+
+    while (this->header->joined.load() > 0){
+      sched_yield();
+    }
+
+    this->header->ready.store(0);
+    return true;
+  }
+
+  //the segment may not exist or be sized yet, or may be a stale one (of the same size) being removed by rank 0
+  while (true){
+    struct stat st;
+
+    this->fd = ::open(path.c_str(), O_RDWR);
+
+    if (this->fd >= 0 && fstat(this->fd, &st) == 0 && (unsigned long)st.st_size == this->bytes && this->map(path)){
+      this->header->joined.fetch_add(1);
+
+      while (this->header->ready.load() == 0 && this->header->stale.load() == 0){
+	sched_yield();
+      }
+
+      if (this->header->stale.load() == 0){
+	this->header->joined.fetch_sub(1);
+	return true;
+      }
+
+      this->unmap();
+    }
+
+    if (this->fd >= 0){
+      close(this->fd);
+      this->fd = -1;
+    }
+
+    usleep(1000);
+  }
+}
+
+bool ShmRing::map(const std::string& path){
+  void* res = mmap(0, this->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+
+  if (res == MAP_FAILED){
+    std::cerr << "Failed to map " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->base = (char*)res;
+  this->header = (ShmRing::Header*)this->base;
+  this->slot = (Real*)(this->base+ShmRing::HEADER_BYTES);
+  this->rowBase = this->slot+2*this->size*this->slotSize;
+  return true;
+}
+
+void ShmRing::unmap(){
+  munmap(this->base, this->bytes);
+  this->base = 0;
+}
+
+void ShmRing::removeStale(const std::string& path){
+  const int fd = ::open(path.c_str(), O_RDWR);
+  struct stat st;
+
+  if (fd < 0){
+    return;
+  }
+
+  if (fstat(fd, &st) == 0 && (unsigned long)st.st_size >= sizeof(ShmRing::Header)){
+    void* res = mmap(0, sizeof(ShmRing::Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (res != MAP_FAILED){
+      ((ShmRing::Header*)res)->stale.store(1);
+      munmap(res, sizeof(ShmRing::Header));
+    }
+  }
+
+  close(fd);
+  unlink(path.c_str());
+  std::cerr << "Removed a stale " << path << std::endl;
+}
+
+//sense-reversing: the last one to arrive resets the count and advances the generation
+void ShmRing::barrier(){
+  const int generation = this->header->generation.load();
+
+  if (this->header->count.fetch_add(1)+1 == this->size){
+    this->header->count.store(0);
+    this->header->generation.fetch_add(1);
+    return;
+  }
+
+  while (this->header->generation.load() == generation){
+    //another run with the same name has replaced the segment
+    if (this->header->stale.load() != 0){
+      std::cerr << "/dev/shm/" << this->name << " was removed by another run" << std::endl;
+      exit(1);
+    }
+
+    sched_yield();
+  }
+}
+
+unsigned long ShmRing::segment(const unsigned long n, const int k, const int size){
+  return n*k/size;
+}
+
+Real* ShmRing::sendSlot(const int r){
+  return this->slot+((this->step%2)*this->size+r)*this->slotSize;
+}
+
+Real* ShmRing::rows(const int r){
+  return this->rowBase+r*this->rowCapacity;
+}
+
+//reduce-scatter and then allgather over the segments of the flat index space of reg;
+//each process sends a segment to the right one through its slot at each step
+void ShmRing::allreduce(ParamRegistry& reg){
+  const unsigned long n = reg.size;
+  const int left = (this->rank+this->size-1)%this->size;
+
+  //after this, the segment (rank+1) of each process has the sum of all the processes
+  for (int s = 0; s < this->size-1; ++s, ++this->step){
+    const int send = (this->rank-s+this->size)%this->size;
+    const int recv = (this->rank-s-1+2*this->size)%this->size;
+
+    reg.getGrad(ShmRing::segment(n, send, this->size), ShmRing::segment(n, send+1, this->size), this->sendSlot(this->rank));
+    this->barrier();
+    reg.addGrad(ShmRing::segment(n, recv, this->size), ShmRing::segment(n, recv+1, this->size), this->sendSlot(left));
+  }
+
+  for (int s = 0; s < this->size-1; ++s, ++this->step){
+    const int send = (this->rank+1-s+this->size)%this->size;
+    const int recv = (this->rank-s+this->size)%this->size;
+
+    reg.getGrad(ShmRing::segment(n, send, this->size), ShmRing::segment(n, send+1, this->size), this->sendSlot(this->rank));
+    this->barrier();
+    reg.setGrad(ShmRing::segment(n, recv, this->size), ShmRing::segment(n, recv+1, this->size), this->sendSlot(left));
+  }
+}
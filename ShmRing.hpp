@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Matrix.hpp"
+#include <string>
+#include <atomic>
+
+class ParamRegistry;
+
+//data-parallel training by several processes on one host (see EncDec::ring): the processes map a segment in /dev/shm,
+//sum the dense gradients by a ring allreduce and exchange the rows of the sparse ones (the embeddings and BlackOut)
+class ShmRing{
+public:
+  ShmRing(const std::string& name_, const int rank_, const int size_):
+    name(name_), rank(rank_), size(size_), rowCapacity(0), fd(-1), base(0), bytes(0), step(0)
+  {};
+  ~ShmRing();
+
+  class Header;
+
+  static const unsigned long HEADER_BYTES = 64; //keeps the buffers aligned
+
+  std::string name; //should be unique among the running jobs; a segment left by a crashed run is replaced by rank 0
+  int rank, size;
+  unsigned long rowCapacity; //# of Reals of the region of the sparse rows of each process
+
+  //maps the segment (created by rank 0, and waited for by the others); called by all the processes with the same sizes before any other call
+  bool open(const unsigned long denseSize, const unsigned long rowCapacity_);
+  void barrier();
+  //sums the gradients of reg over the processes; the result is the same bits in all of them
+  void allreduce(ParamRegistry& reg);
+  //the region where the process r writes its rows; written before a barrier and read by all after it
+  Real* rows(const int r);
+
+private:
+  int fd;
+  char* base;
+  unsigned long bytes;
+  ShmRing::Header* header;
+  Real* slot; //2 x size slots (double buffered, to need one barrier per step)
+  unsigned long slotSize;
+  Real* rowBase;
+  unsigned long step;
+
+  bool map(const std::string& path);
+  void unmap();
+  Real* sendSlot(const int r);
+  static unsigned long segment(const unsigned long n, const int k, const int size);
+  //marks the segment at path as stale (so that the processes waiting on it give up) and removes it
+  static void removeStale(const std::string& path);
+};
+
+//zero-filled when the segment is created, which is the initial state of the counters
+class ShmRing::Header{
+public:
+  std::atomic<int> count;
+  std::atomic<int> generation;
+  std::atomic<int> joined; //# of the processes other than rank 0 that have mapped the segment in open
+  std::atomic<int> ready; //set by rank 0 while they are released from open (cleared after, so that a stale segment is not ready)
+  std::atomic<int> stale; //set by rank 0 of a new run before it removes the segment
+};
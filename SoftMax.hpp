@@ -2,6 +2,7 @@
 
 #include "Matrix.hpp"
 #include "Optimizer.hpp"
+#include "ParamRegistry.hpp"
 
 class SoftMax{
 public:
@@ -75,6 +76,11 @@ public:
     Optimizer::sgd(this->bias, learningRate, softmax.bias);
   }
 
+  void registerParams(const std::string& prefix, SoftMax& softmax, ParamRegistry& reg){
+    reg.add(prefix+"weight", softmax.weight, this->weight);
+    reg.add(prefix+"bias", softmax.bias, this->bias);
+  }
+
   void adagrad(const Real learningRate, SoftMax& softmax, const Real initVal = 1.0){
     if (this->gradHist == 0){
       this->gradHist = new SoftMax::Grad(softmax);
@@ -0,0 +1,76 @@
+#include "SyntheticCorpus.hpp"
+#include <algorithm>
+#include <sstream>
+
+void SyntheticCorpus::init(){
+  Real sum = 0.0;
+
+  this->cdf.resize(this->vocSize);
+
+  for (int i = 0; i < this->vocSize; ++i){
+    sum += pow(i+1.0, -this->zipf);
+    this->cdf[i] = sum;
+  }
+  for (int i = 0; i < this->vocSize; ++i){
+    this->cdf[i] /= sum;
+  }
+}
+
+void SyntheticCorpus::tokenCount(std::unordered_map<std::string, int>& count, int& eosCount){
+  const Real total = this->pairs*this->meanLength;
+
+  count.clear();
+
+  for (int i = 0; i < this->vocSize; ++i){
+    //at least once, so that every rank is in the vocabulary
+    count[this->token(i)] = std::max(1, (int)(total*(this->cdf[i]-(i == 0 ? 0.0 : this->cdf[i-1]))));
+  }
+
+  eosCount = this->pairs;
+}
+
+std::string SyntheticCorpus::token(const int rank){
+  std::ostringstream oss;
+
+  oss << "w" << rank;
+  return oss.str();
+}
+
+void SyntheticCorpus::generate(const unsigned long index, const Vocabulary& sourceVoc, const Vocabulary& targetVoc, EncDec::Data* data){
+  Rand rnd(88675123+index);
+  Real len;
+  int srcLen, tgtLen;
+
+  for (int i = 0; i < 4; ++i){
+    rnd.next(); //the first outputs depend on the seed too much
+  }
+
+  len = rnd.gauss(this->sdLength, this->meanLength);
+  srcLen = (len >= 1.0 ? std::min((int)(len+0.5), this->maxLength) : 1);
+  len = rnd.gauss(0.1*this->sdLength, 1.1*srcLen);
+  tgtLen = (len >= 1.0 ? std::min((int)(len+0.5), this->maxLength) : 1);
+
+  data->src.clear();
+  data->tgt.clear();
+
+  for (int i = 0; i < srcLen; ++i){
+    const int rank = std::lower_bound(this->cdf.begin(), this->cdf.end(), rnd.zero2one53())-this->cdf.begin();
+
+    data->src.push_back(sourceVoc.tokenIndex.at(this->token(std::min(rank, this->vocSize-1))));
+  }
+  for (int i = 0; i < tgtLen; ++i){
+    const int rank = std::lower_bound(this->cdf.begin(), this->cdf.end(), rnd.zero2one53())-this->cdf.begin();
+
+    data->tgt.push_back(targetVoc.tokenIndex.at(this->token(std::min(rank, this->vocSize-1))));
+  }
+
+  data->src.push_back(sourceVoc.eosIndex);
+  data->tgt.push_back(targetVoc.eosIndex);
+}
+
+void SyntheticCorpus::sample(const int num, const Vocabulary& sourceVoc, const Vocabulary& targetVoc, Rand& rnd, std::vector<EncDec::Data*>& data){
+  for (int i = 0; i < num; ++i){
+    data.push_back(new EncDec::Data);
+    this->generate(rnd.next()%this->pairs, sourceVoc, targetVoc, data.back());
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "EncDec.hpp"
+#include "Vocabulary.hpp"
+#include "Rand.hpp"
+#include <unordered_map>
+
+//synthetic parallel corpus with Zipfian vocabularies, for benchmarking without external data;
+//the i-th pair is generated deterministically from i, so that the corpus itself is never stored
+class SyntheticCorpus{
+public:
+  SyntheticCorpus(const unsigned long pairs_, const int vocSize_, const Real zipf_ = 1.0,
+		  const Real meanLength_ = 20.0, const Real sdLength_ = 8.0, const int maxLength_ = 50):
+    pairs(pairs_), vocSize(vocSize_), zipf(zipf_), meanLength(meanLength_), sdLength(sdLength_), maxLength(maxLength_)
+  {
+    this->init();
+  };
+
+  unsigned long pairs; //# of sentence pairs
+  int vocSize; //# of token types on each side
+  Real zipf; //exponent of the rank-frequency distribution
+  Real meanLength, sdLength; //source length ~ N(meanLength, sdLength^2), clipped to [1, maxLength]
+  int maxLength;
+  std::vector<Real> cdf; //cumulative distribution over the ranks
+
+  void init();
+  //expected token counts over the whole corpus, to build the vocabularies
+  void tokenCount(std::unordered_map<std::string, int>& count, int& eosCount);
+  std::string token(const int rank);
+  void generate(const unsigned long index, const Vocabulary& sourceVoc, const Vocabulary& targetVoc, EncDec::Data* data);
+  //num pairs drawn uniformly from the corpus
+  void sample(const int num, const Vocabulary& sourceVoc, const Vocabulary& targetVoc, Rand& rnd, std::vector<EncDec::Data*>& data);
+};
@@ -0,0 +1,183 @@
+#include "TranslationServer.hpp"
+#include "Utils.hpp"
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+TranslationServer::TranslationServer(EncDec& encdec_, const int numThreads_, const int beam_, const int maxLength_, const int tokenBudget, const Real maxLatency):
+  encdec(encdec_), numThreads(numThreads_), beam(beam_), maxLength(maxLength_),
+  scheduler(tokenBudget, maxLatency), requestCount(0)
+{}
+
+int TranslationServer::listenUnix(const std::string& path){
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+  ::unlink(path.c_str());
+
+  if (fd < 0 || ::bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0){
+    std::cerr << "Failed to listen on " << path << ": " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  return fd;
+}
+
+int TranslationServer::listenTCP(const int port){
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  const int on = 1;
+  struct sockaddr_in addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); //localhost only
+  ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if (fd < 0 || ::bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0){
+    std::cerr << "Failed to listen on port " << port << ": " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  return fd;
+}
+
+void TranslationServer::run(const int listenFd){
+  std::vector<std::thread> workers;
+
+  for (int i = 0; i < this->numThreads; ++i){
+    workers.push_back(std::thread(&TranslationServer::work, this));
+  }
+
+  for (int fd; (fd = ::accept(listenFd, 0, 0)) >= 0 || errno == EINTR; ){
+    if (fd >= 0){
+      std::thread(&TranslationServer::receive, this, std::make_shared<TranslationServer::Connection>(fd)).detach();
+    }
+  }
+
+  this->scheduler.close();
+
+  for (auto it = workers.begin(); it != workers.end(); ++it){
+    it->join();
+  }
+}
+
+void TranslationServer::receive(std::shared_ptr<TranslationServer::Connection> conn){
+  std::string buf;
+  char chunk[4096];
+  int seq = 0;
+
+  //one source sentence per line
+  for (ssize_t len; (len = ::recv(conn->fd, chunk, sizeof(chunk), 0)) > 0; ){
+    buf.append(chunk, len);
+
+    for (size_t pos; (pos = buf.find('\n')) != std::string::npos; ){
+      this->push(conn, buf.substr(0, pos), seq++);
+      buf.erase(0, pos+1);
+    }
+  }
+
+  //the last line without a newline
+  if (!buf.empty()){
+    this->push(conn, buf, seq++);
+  }
+}
+
+void TranslationServer::push(std::shared_ptr<TranslationServer::Connection> conn, const std::string& line, const int seq){
+  TranslationServer::Request* req = new TranslationServer::Request;
+  std::vector<std::string> tokens;
+  int id;
+
+  req->arrival = std::chrono::steady_clock::now();
+  req->conn = conn;
+  req->seq = seq;
+  Utils::split(line, tokens);
+
+  for (auto it = tokens.begin(); it != tokens.end(); ++it){
+    req->src.push_back(this->encdec.sourceVoc.tokenIndex.count(*it) ? this->encdec.sourceVoc.tokenIndex.at(*it) : this->encdec.sourceVoc.unkIndex);
+  }
+
+  req->src.push_back(this->encdec.sourceVoc.eosIndex);
+
+  {
+    std::lock_guard<std::mutex> lock(this->mtx);
+
+    id = this->requestCount++;
+    this->requests[id] = req;
+  }
+
+  this->scheduler.push(id, req->src.size());
+}
+
+void TranslationServer::work(){
+  EncDec::Workspace ws; //reused by all the requests served by this thread
+  BatchScheduler::Batch batch;
+  std::vector<int> output;
+
+  while (this->scheduler.pop(batch)){
+    for (auto id = batch.id.begin(); id != batch.id.end(); ++id){
+      TranslationServer::Request* req;
+      std::ostringstream oss;
+
+      {
+	std::lock_guard<std::mutex> lock(this->mtx);
+
+	req = this->requests.at(*id);
+	this->requests.erase(*id);
+      }
+
+      this->encdec.translate(output, req->src, this->beam, this->maxLength, ws);
+
+      for (auto it = output.begin(); it != output.end(); ++it){
+	oss << this->encdec.targetVoc.tokenList[*it]->str << (it+1 == output.end() ? "" : " ");
+      }
+
+      req->conn->reply(req->seq, oss.str());
+
+      const Real latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-req->arrival).count();
+
+      {
+	std::lock_guard<std::mutex> lock(this->mtx);
+
+	std::cout << "Request " << *id << ": " << req->src.size() << " tokens, " << batch.id.size() << " in batch, " << latency << " ms" << std::endl;
+      }
+
+      delete req;
+    }
+  }
+}
+
+TranslationServer::Connection::~Connection(){
+  ::close(this->fd);
+}
+
+void TranslationServer::Connection::reply(const int seq, const std::string& text){
+  std::lock_guard<std::mutex> lock(this->mtx);
+
+  this->pending[seq] = text+"\n";
+
+  for (auto it = this->pending.begin(); it != this->pending.end() && it->first == this->sent; it = this->pending.begin()){
+    for (size_t done = 0; done < it->second.size(); ){
+      const ssize_t len = ::send(this->fd, it->second.c_str()+done, it->second.size()-done, MSG_NOSIGNAL);
+
+      if (len <= 0){
+	break; //the client has gone away
+      }
+
+      done += len;
+    }
+
+    this->pending.erase(it);
+    ++this->sent;
+  }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "EncDec.hpp"
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+class TranslationServer{
+public:
+  TranslationServer(EncDec& encdec_, const int numThreads_, const int beam_, const int maxLength_, const int tokenBudget, const Real maxLatency);
+
+  class Connection;
+  class Request;
+
+  EncDec& encdec;
+  int numThreads;
+  int beam, maxLength;
+  BatchScheduler scheduler;
+  std::unordered_map<int, TranslationServer::Request*> requests;
+  int requestCount;
+  std::mutex mtx; //for requests and logging
+
+  int listenUnix(const std::string& path);
+  int listenTCP(const int port);
+  void run(const int listenFd);
+  void receive(std::shared_ptr<TranslationServer::Connection> conn);
+  //a request for a line, which is translated by one of the workers
+  void push(std::shared_ptr<TranslationServer::Connection> conn, const std::string& line, const int seq);
+  void work();
+};
+
+class TranslationServer::Connection{
+public:
+  Connection(const int fd_):
+    fd(fd_), sent(0)
+  {};
+  ~Connection();
+
+  int fd;
+  int sent;
+  std::map<int, std::string> pending; //reorder buffer to reply in the request order
+  std::mutex mtx;
+
+  void reply(const int seq, const std::string& text);
+};
+
+class TranslationServer::Request{
+public:
+  std::shared_ptr<TranslationServer::Connection> conn;
+  int seq;
+  std::vector<int> src;
+  std::chrono::steady_clock::time_point arrival;
+};
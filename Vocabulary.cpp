@@ -3,17 +3,18 @@
 #include <fstream>
 #include <iostream>
 
+namespace {
 struct sort_pred {
   bool operator()(const Vocabulary::Token* left, const Vocabulary::Token* right) {
     return left->count > right->count;
   }
 };
+}
 
 Vocabulary::Vocabulary(const std::string& trainFile, const int tokenFreqThreshold){
   std::ifstream ifs(trainFile.c_str());
   std::vector<std::string> tokens;
   std::unordered_map<std::string, int> tokenCount;
-  int unkCount = 0;
   int eosCount = 0;
 
   for (std::string line; std::getline(ifs, line); ){
@@ -32,6 +33,17 @@ Vocabulary::Vocabulary(const std::string& trainFile, const int tokenFreqThreshol
     }
   }
 
+  this->build(tokenCount, eosCount, tokenFreqThreshold);
+}
+
+//from the token counts directly (e.g., synthetic corpora)
+Vocabulary::Vocabulary(const std::unordered_map<std::string, int>& tokenCount, const int eosCount, const int tokenFreqThreshold){
+  this->build(tokenCount, eosCount, tokenFreqThreshold);
+}
+
+void Vocabulary::build(const std::unordered_map<std::string, int>& tokenCount, const int eosCount, const int tokenFreqThreshold){
+  int unkCount = 0;
+
   for (auto it = tokenCount.begin(); it != tokenCount.end(); ++it){
     if (it->second >= tokenFreqThreshold){
       this->tokenList.push_back(new Vocabulary::Token(it->first, it->second));
@@ -7,6 +7,7 @@
 class Vocabulary{
 public:
   Vocabulary(const std::string& trainFile, const int tokenFreqThreshold);
+  Vocabulary(const std::unordered_map<std::string, int>& tokenCount, const int eosCount, const int tokenFreqThreshold);
 
   class Token;
 
@@ -14,6 +15,8 @@ public:
   std::vector<Vocabulary::Token*> tokenList;
   int eosIndex;
   int unkIndex;
+
+  void build(const std::unordered_map<std::string, int>& tokenCount, const int eosCount, const int tokenFreqThreshold);
 };
 
 class Vocabulary::Token{
@@ -0,0 +1,832 @@
+#include "LSTM.hpp"
+#include "DeepLSTM.hpp"
+#include "LnLSTM.hpp"
+#include "GRU.hpp"
+#include "TreeLSTM.hpp"
+#include "QuantLSTM.hpp"
+#include "HalfMat.hpp"
+#include "SoftMax.hpp"
+#include "BlackOut.hpp"
+#include "ActFunc.hpp"
+#include "Utils.hpp"
+#include "EncDec.hpp"
+#include "SyntheticCorpus.hpp"
+#include "Numa.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <omp.h>
+
+//microbenchmarks of the kernels (-mode kernel), end-to-end training throughput on synthetic corpora (-mode train),
+//and the memory bandwidth between the NUMA nodes (-mode numa); the results are written in JSON
+
+#define N3LP_ALLOC_HOOKS //allocations by Eigen (std::malloc) and operator new are counted
+#include "AllocTracker.hpp"
+
+class Bench{
+public:
+  Bench(const Real minTime_, const std::string& filter_, const Real maxAllocs_ = -1.0):
+    minTime(minTime_), filter(filter_), maxAllocs(maxAllocs_), failed(false)
+  {}
+
+  Real minTime; //in seconds
+  std::string filter;
+  Real maxAllocs; //regression gate: allocations per op (kernel) or per step (train) (< 0: not used)
+  bool failed;
+  std::vector<std::string> result;
+
+  void check(const std::string& name, const Real allocs){
+    if (this->maxAllocs >= 0.0 && allocs > this->maxAllocs){
+      std::cerr << "Allocation gate failed: " << name << " allocates " << allocs << " times (> " << this->maxAllocs << ")" << std::endl;
+      this->failed = true;
+    }
+  }
+
+  //func is called repeatedly (doubling the count) until minTime passes; flop <= 0 means no FLOP count
+  template <typename F>
+  void run(const std::string& name, const int hidden, const int vocab, const int length, const Real flop, F func){
+    struct timeval start, end;
+    unsigned long iter = 1, count, bytes;
+    Real elapsed;
+
+    if (this->filter != "" && name.find(this->filter) == std::string::npos){
+      return;
+    }
+
+    func(); //warm-up
+
+    while (true){
+      count = AllocTracker::totalCount.load();
+      bytes = AllocTracker::totalBytes.load();
+      gettimeofday(&start, 0);
+      for (unsigned long i = 0; i < iter; ++i){
+	func();
+      }
+      gettimeofday(&end, 0);
+      count = AllocTracker::totalCount.load()-count;
+      bytes = AllocTracker::totalBytes.load()-bytes;
+      elapsed = (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06;
+
+      if (elapsed >= this->minTime){
+	break;
+      }
+
+      iter *= 2;
+    }
+
+    const Real ns = elapsed*1.0e+09/iter;
+    std::ostringstream oss;
+
+    oss << "    {\"name\": \"" << name << "\", \"hidden\": " << hidden << ", \"vocab\": " << vocab << ", \"length\": " << length
+	<< ", \"iterations\": " << iter << ", \"ns_per_op\": " << ns << ", \"gflops\": ";
+    if (flop > 0.0){
+      oss << flop/ns;
+    }
+    else {
+      oss << "null";
+    }
+    oss << ", \"bytes_per_op\": " << (Real)bytes/iter << ", \"allocs_per_op\": " << (Real)count/iter << "}";
+
+    this->result.push_back(oss.str());
+    this->check(name, (Real)count/iter);
+    std::cerr << name << " (H=" << hidden << ", V=" << vocab << ", T=" << length << "): " << ns << " ns/op" << std::endl;
+  }
+
+  void write(std::ostream& os, const std::string& mode, const std::string& hiddenList, const std::string& vocabList){
+    os << "{" << std::endl;
+    os << "  \"context\": {\"mode\": \"" << mode << "\", \"real_bytes\": " << sizeof(Real) << ", \"min_time\": " << this->minTime
+       << ", \"hidden\": \"" << hiddenList << "\", \"vocab\": \"" << vocabList << "\"}," << std::endl;
+    os << "  \"benchmarks\": [" << std::endl;
+    for (int i = 0; i < (int)this->result.size(); ++i){
+      os << this->result[i] << (i+1 < (int)this->result.size() ? "," : "") << std::endl;
+    }
+    os << "  ]" << std::endl;
+    os << "}" << std::endl;
+  }
+};
+
+static const std::string optimizerName[] = {"sgd", "adagrad", "momentum", "rmsprop", "adam", "adamw"};
+
+//EncDec::trainOpenMP for a fixed # of mini batches; each setting runs in a child process to measure its own peak RSS
+class TrainBench{
+public:
+  TrainBench(const unsigned long pairs_, const int batches_, const int miniBatchSize_,
+	     const Real zipf_, const Real meanLength_, const Real sdLength_, const int maxLength_, const Optimizer::TYPE optimizer_,
+	     const int maxStaleness_, const bool pinThreads_):
+    pairs(pairs_), batches(batches_), miniBatchSize(miniBatchSize_),
+    zipf(zipf_), meanLength(meanLength_), sdLength(sdLength_), maxLength(maxLength_), optimizer(optimizer_),
+    maxStaleness(maxStaleness_), pinThreads(pinThreads_)
+  {}
+
+  unsigned long pairs;
+  int batches, miniBatchSize;
+  Real zipf, meanLength, sdLength;
+  int maxLength;
+  Optimizer::TYPE optimizer;
+  int maxStaleness; //for the asynchronous mode
+  bool pinThreads; //see EncDec::pinThreads
+
+  //returns tokens/sec, and the allocations per step and the JSON fields of the result
+  Real run(const int H, const int V, const int numThreads, const bool async, Real& allocsPerStep, std::string& res){
+    SyntheticCorpus corpus(this->pairs, V, this->zipf, this->meanLength, this->sdLength, this->maxLength);
+    std::unordered_map<std::string, int> tokenCount;
+    int eosCount;
+
+    corpus.tokenCount(tokenCount, eosCount);
+
+    Vocabulary sourceVoc(tokenCount, eosCount, 1);
+    Vocabulary targetVoc(tokenCount, eosCount, 1);
+    std::vector<EncDec::Data*> trainData, devData;
+    unsigned long tokens = 0, count, bytes;
+    struct timeval start, end;
+    struct rusage usage;
+    Rand rnd;
+
+    corpus.sample(this->batches*this->miniBatchSize, sourceVoc, targetVoc, rnd, trainData);
+
+    for (auto it = trainData.begin(); it != trainData.end(); ++it){
+      tokens += (*it)->src.size()+(*it)->tgt.size();
+    }
+
+    const Real learningRate = (this->optimizer == Optimizer::SGD ? 0.5 : 0.001);
+    const bool useBlackout = true;
+    EncDec encdec(sourceVoc, targetVoc, trainData, devData, H, H, useBlackout);
+
+    encdec.optimizer = Optimizer(this->optimizer);
+    encdec.asynchronous = async;
+    encdec.maxStaleness = this->maxStaleness;
+    encdec.pinThreads = this->pinThreads;
+
+    encdec.trainOpenMP(learningRate, this->miniBatchSize, numThreads); //warm-up (the per-thread buffers are allocated here)
+
+    count = AllocTracker::totalCount.load();
+    bytes = AllocTracker::totalBytes.load();
+    gettimeofday(&start, 0);
+    encdec.trainOpenMP(learningRate, this->miniBatchSize, numThreads);
+    gettimeofday(&end, 0);
+    count = AllocTracker::totalCount.load()-count;
+    bytes = AllocTracker::totalBytes.load()-bytes;
+    getrusage(RUSAGE_SELF, &usage);
+
+    const Real elapsed = (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06;
+    const unsigned long stepCount = count, stepBytes = bytes;
+
+    //decoding some of the training sentences after the workspace is warmed up
+    const int decodeNum = 16;
+    const int beam = 5;
+    const int maxDecodeLength = 100;
+    EncDec::Workspace ws;
+    std::vector<int> output;
+
+    encdec.translate(output, trainData[0]->src, beam, maxDecodeLength, ws);
+    count = AllocTracker::totalCount.load();
+    bytes = AllocTracker::totalBytes.load();
+    for (int i = 0; i < decodeNum; ++i){
+      encdec.translate(output, trainData[i%trainData.size()]->src, beam, maxDecodeLength, ws);
+    }
+    count = AllocTracker::totalCount.load()-count;
+    bytes = AllocTracker::totalBytes.load()-bytes;
+
+    std::ostringstream oss;
+
+    allocsPerStep = (Real)stepCount/this->batches;
+    oss << "\"name\": \"EncDec::trainOpenMP\", \"hidden\": " << H << ", \"vocab\": " << V << ", \"threads\": " << numThreads
+	<< ", \"pairs\": " << this->pairs << ", \"batches\": " << this->batches << ", \"mini_batch\": " << this->miniBatchSize
+	<< ", \"optimizer\": \"" << optimizerName[this->optimizer] << "\", \"async\": " << (async ? "true" : "false")
+	<< ", \"max_staleness\": " << this->maxStaleness << ", \"pinned\": " << (this->pinThreads ? "true" : "false") << ", \"tokens\": " << tokens << ", \"sec\": " << elapsed << ", \"tokens_per_sec\": " << tokens/elapsed
+	<< ", \"peak_rss_kb\": " << usage.ru_maxrss
+	<< ", \"allocs_per_step\": " << allocsPerStep << ", \"bytes_per_step\": " << (Real)stepBytes/this->batches
+	<< ", \"beam\": " << beam << ", \"allocs_per_sentence\": " << (Real)count/decodeNum << ", \"bytes_per_sentence\": " << (Real)bytes/decodeNum;
+    res = oss.str();
+
+    return tokens/elapsed;
+  }
+
+  bool runChild(const int H, const int V, const int numThreads, const bool async, Real& tps, Real& allocsPerStep, std::string& res){
+    int fd[2];
+    pid_t pid;
+    int status;
+    char buf[4096];
+    ssize_t n;
+    std::string out;
+
+    if (pipe(fd) != 0 || (pid = fork()) < 0){
+      return false;
+    }
+
+    if (pid == 0){
+      close(fd[0]);
+      dup2(2, 1); //the training progress goes to stderr
+      tps = this->run(H, V, numThreads, async, allocsPerStep, res);
+      std::ostringstream oss;
+      oss << tps << " " << allocsPerStep << " " << res;
+      out = oss.str();
+      for (size_t i = 0; i < out.size(); i += n){
+	if ((n = write(fd[1], out.c_str()+i, out.size()-i)) <= 0){
+	  break;
+	}
+      }
+      close(fd[1]);
+      _exit(0);
+    }
+
+    close(fd[1]);
+    while ((n = read(fd[0], buf, sizeof(buf))) > 0){
+      out.append(buf, n);
+    }
+    close(fd[0]);
+    waitpid(pid, &status, 0);
+
+    std::istringstream iss(out);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !(iss >> tps >> allocsPerStep)){
+      return false;
+    }
+
+    std::getline(iss, res);
+    res = res.substr(1);
+    return true;
+  }
+};
+
+static void parseList(const std::string& str, std::vector<int>& res){
+  std::vector<std::string> tokens;
+
+  Utils::split(str, tokens, ',');
+  res.clear();
+
+  for (auto it = tokens.begin(); it != tokens.end(); ++it){
+    res.push_back(atoi(it->c_str()));
+  }
+}
+
+static Real numaSink = 0.0;
+
+//reads (sum) and triad (a = b+s*c) by all the cores of a node, over the memory first touched by the cores of each node;
+//the remote pairs show what the threads pay for not working on their own node
+static void benchNuma(Bench& bench, const unsigned long bytes){
+  const int nodeNum = Numa::nodeNum();
+  const long n = bytes/(3*sizeof(Real));
+  const std::string kernelName[] = {"read", "triad"};
+
+  for (int cpu = 0; cpu < nodeNum; ++cpu){
+    const int threads = Numa::cpus(cpu).size();
+    Real local[2] = {0.0, 0.0};
+
+    //the local node first, as the baseline
+    for (int k = 0; k < nodeNum; ++k){
+      const int mem = (cpu+k)%nodeNum;
+      Real* a = (Real*)std::malloc(3*n*sizeof(Real));
+      Real* b = a+n;
+      Real* c = b+n;
+      std::ostringstream oss;
+
+      if (a == 0){
+	std::cerr << "Failed to allocate " << bytes << " bytes" << std::endl;
+	bench.failed = true;
+	return;
+      }
+
+#pragma omp parallel num_threads(Numa::cpus(mem).size())
+      {
+	Numa::pinToNode(mem, omp_get_thread_num());
+
+#pragma omp for schedule(static)
+	for (long i = 0; i < 3*n; ++i){
+	  a[i] = 1.0;
+	}
+      }
+
+      oss << "    {\"name\": \"numa\", \"cpu_node\": " << cpu << ", \"mem_node\": " << mem << ", \"page_node\": " << Numa::pageNode(b)
+	  << ", \"threads\": " << threads << ", \"bytes\": " << 3*n*sizeof(Real);
+
+      for (int kernel = 0; kernel < 2; ++kernel){
+	struct timeval start, end;
+	unsigned long iter = 1;
+	Real elapsed;
+
+	while (true){
+	  gettimeofday(&start, 0);
+
+#pragma omp parallel num_threads(threads)
+	  {
+	    const int id = omp_get_thread_num();
+	    const long beg = n*id/threads, last = n*(id+1)/threads;
+	    Real sum = 0.0;
+
+	    Numa::pinToNode(cpu, id);
+
+	    for (unsigned long r = 0; r < iter; ++r){
+	      if (kernel == 0){
+		for (long i = beg; i < last; ++i){
+		  sum += a[i]+b[i]+c[i];
+		}
+	      }
+	      else {
+		for (long i = beg; i < last; ++i){
+		  a[i] = b[i]+0.5*c[i];
+		}
+	      }
+	    }
+
+#pragma omp atomic
+	    numaSink += sum;
+	  }
+
+	  gettimeofday(&end, 0);
+	  elapsed = (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06;
+
+	  if (elapsed >= bench.minTime){
+	    break;
+	  }
+
+	  iter *= 2;
+	}
+
+	const Real gbps = 3.0*n*sizeof(Real)*iter/elapsed*1.0e-09;
+
+	if (k == 0){
+	  local[kernel] = gbps;
+	}
+
+	oss << ", \"" << kernelName[kernel] << "_gb_per_sec\": " << gbps << ", \"" << kernelName[kernel] << "_vs_local\": " << gbps/local[kernel];
+	std::cerr << "numa " << kernelName[kernel] << " (cpu node " << cpu << ", memory node " << mem << "): " << gbps << " GB/sec" << std::endl;
+      }
+
+      oss << "}";
+      bench.result.push_back(oss.str());
+      std::free(a);
+    }
+  }
+}
+
+static void benchRecurrent(Bench& bench, const int H, Rand& rnd){
+  const int T = 32;
+  const Real scale = 0.1;
+  VecD x(H);
+
+  rnd.uniform(x, 1.0);
+
+  {
+    LSTM lstm(H, H);
+    LSTM::Grad grad(lstm);
+    LSTM::State prev, cur;
+
+    lstm.init(rnd, scale);
+    prev.h = VecD(H); prev.c = VecD(H);
+    rnd.uniform(prev.h, 1.0); rnd.uniform(prev.c, 1.0);
+    lstm.forward(x, &prev, &cur);
+
+    bench.run("LSTM::forward", H, 0, 1, 8.0*H*(H+H), [&](){
+	lstm.forward(x, &prev, &cur);
+      });
+    bench.run("LSTM::backward", H, 0, 1, 16.0*H*(H+H), [&](){
+	prev.delh.setZero(H); prev.delc.setZero(H);
+	cur.delh.setOnes(H); cur.delc.setZero(H);
+	lstm.backward(&prev, &cur, grad, x);
+      });
+
+    MatD xs(H, T);
+    std::vector<LSTM::State*> state;
+
+    rnd.uniform(xs, 1.0);
+    for (int t = 0; t <= T; ++t){
+      state.push_back(new LSTM::State);
+    }
+    state[0]->h = prev.h; state[0]->c = prev.c;
+    lstm.forwardSeq(xs, state);
+
+    bench.run("LSTM::forwardSeq", H, 0, T, 8.0*H*(H+H)*T, [&](){
+	lstm.forwardSeq(xs, state);
+      });
+
+    //int8 inference (the flop counts are integer ops here)
+    QuantLSTM qlstm(lstm);
+
+    bench.run("QuantLSTM::forward", H, 0, 1, 8.0*H*(H+H), [&](){
+	qlstm.forward(x, state[0], state[1]);
+      });
+    bench.run("LSTM::backwardSeq", H, 0, T, 16.0*H*(H+H)*T, [&](){
+	for (int t = 0; t <= T; ++t){
+	  state[t]->delh.setOnes(H);
+	}
+	state[T]->delc.setZero(H);
+	lstm.backwardSeq(xs, state, grad);
+      });
+
+    for (int t = 0; t <= T; ++t){
+      delete state[t];
+    }
+  }
+
+  {
+    LnLSTM lnlstm(H, H);
+    LnLSTM::Grad grad(lnlstm);
+    LnLSTM::State prev, cur;
+
+    lnlstm.init(rnd, scale);
+    prev.h = VecD(H); prev.c = VecD(H);
+    rnd.uniform(prev.h, 1.0); rnd.uniform(prev.c, 1.0);
+    lnlstm.forward(x, &prev, &cur);
+
+    bench.run("LnLSTM::forward", H, 0, 1, 8.0*H*(H+H), [&](){
+	lnlstm.forward(x, &prev, &cur);
+      });
+    bench.run("LnLSTM::backward", H, 0, 1, 16.0*H*(H+H), [&](){
+	prev.delh.setZero(H); prev.delc.setZero(H);
+	cur.delh.setOnes(H); cur.delc.setZero(H);
+	lnlstm.backward(&prev, &cur, grad, x);
+      });
+  }
+
+  {
+    GRU gru(H, H);
+    GRU::Grad grad(gru);
+    GRU::State prev, cur;
+
+    gru.init(rnd, scale);
+    prev.h = VecD(H);
+    rnd.uniform(prev.h, 1.0);
+    gru.forward(x, &prev, &cur);
+
+    bench.run("GRU::forward", H, 0, 1, 6.0*H*(H+H), [&](){
+	gru.forward(x, &prev, &cur);
+      });
+    bench.run("GRU::backward", H, 0, 1, 12.0*H*(H+H), [&](){
+	prev.delh.setZero(H);
+	cur.delh.setOnes(H);
+	gru.backward(&prev, &cur, grad, x);
+      });
+  }
+
+  {
+    TreeLSTM tlstm(H, H);
+    TreeLSTM::Grad grad(tlstm);
+    TreeLSTM::State parent;
+    LSTM::State left, right;
+
+    tlstm.init(rnd, scale);
+    left.h = VecD(H); left.c = VecD(H);
+    right.h = VecD(H); right.c = VecD(H);
+    rnd.uniform(left.h, 1.0); rnd.uniform(left.c, 1.0);
+    rnd.uniform(right.h, 1.0); rnd.uniform(right.c, 1.0);
+    tlstm.forward(x, &parent, &left, &right);
+
+    bench.run("TreeLSTM::forward", H, 0, 1, 10.0*H*(H+2*H), [&](){
+	tlstm.forward(x, &parent, &left, &right);
+      });
+    bench.run("TreeLSTM::backward", H, 0, 1, 20.0*H*(H+2*H), [&](){
+	left.delh.setZero(H); left.delc.setZero(H);
+	right.delh.setZero(H); right.delc.setZero(H);
+	parent.delh.setOnes(H); parent.delc.setZero(H);
+	tlstm.backward(&parent, &left, &right, grad, x);
+      });
+  }
+
+  //layer by layer vs. the wavefront (a thread per layer), which forwardSeq/backwardSeq choose by DeepLSTM::useWavefront
+  for (int depth = 2; depth <= 4; depth *= 2){
+    DeepLSTM dlstm(H, H, depth);
+    DeepLSTM::Grad grad(dlstm);
+    std::ostringstream oss;
+
+    dlstm.init(rnd, scale);
+    oss << "(depth=" << depth << ")";
+
+    for (int len = 8; len <= 128; len *= 4){
+      MatD xs(H, len);
+      std::vector<DeepLSTM::State*> state;
+
+      rnd.uniform(xs, 1.0);
+      for (int t = 0; t <= len; ++t){
+	state.push_back(new DeepLSTM::State(dlstm));
+      }
+      for (int i = 0; i < depth; ++i){
+	state[0]->lstm[i]->h = VecD(H); state[0]->lstm[i]->c = VecD(H);
+	rnd.uniform(state[0]->lstm[i]->h, 1.0); rnd.uniform(state[0]->lstm[i]->c, 1.0);
+      }
+
+      auto initDelta = [&](){
+	for (int t = 0; t <= len; ++t){
+	  for (int i = 0; i < depth; ++i){
+	    state[t]->lstm[i]->delh.setOnes(H);
+	    state[t]->lstm[i]->delc.setZero(H);
+	  }
+	}
+      };
+
+      bench.run("DeepLSTM::forwardLayers"+oss.str(), H, 0, len, 8.0*H*(H+H)*len*depth, [&](){
+	  dlstm.forwardLayers(xs, state);
+	});
+      bench.run("DeepLSTM::forwardWavefront"+oss.str(), H, 0, len, 8.0*H*(H+H)*len*depth, [&](){
+	  dlstm.forwardWavefront(xs, state);
+	});
+      bench.run("DeepLSTM::backwardLayers"+oss.str(), H, 0, len, 16.0*H*(H+H)*len*depth, [&](){
+	  initDelta();
+	  dlstm.backwardLayers(xs, state, grad);
+	});
+      bench.run("DeepLSTM::backwardWavefront"+oss.str(), H, 0, len, 16.0*H*(H+H)*len*depth, [&](){
+	  initDelta();
+	  dlstm.backwardWavefront(xs, state, grad);
+	});
+
+      for (int t = 0; t <= len; ++t){
+	delete state[t];
+      }
+    }
+  }
+
+  {
+    VecD y(H);
+
+    rnd.uniform(y, 1.0);
+    bench.run("ActFunc::tanh", H, 0, 1, 0.0, [&](){
+	ActFunc::tanh(y);
+      });
+    rnd.uniform(y, 1.0);
+    bench.run("ActFunc::logistic", H, 0, 1, 0.0, [&](){
+	ActFunc::logistic(y);
+      });
+  }
+}
+
+static void benchOutput(Bench& bench, const int H, const int V, Rand& rnd){
+  const int numSample = 100;
+  VecD x(H), dist;
+
+  rnd.uniform(x, 1.0);
+
+  {
+    SoftMax softmax(H, V);
+
+    rnd.uniform(softmax.weight, 0.1);
+    bench.run("SoftMax::calcDist", H, V, 1, 2.0*H*V, [&](){
+	softmax.calcDist(x, dist);
+      });
+
+    QuantMat weight;
+    QuantVec q;
+
+    weight.quantizeCols(softmax.weight);
+    bench.run("QuantMat::gemv", H, V, 1, 2.0*H*V, [&](){
+	dist = softmax.bias;
+	q.quantize(x, weight.stride);
+	weight.gemv(q, dist);
+      });
+
+    HalfMat half[2];
+    const std::string halfName[] = {"HalfMat::gemv(bf16)", "HalfMat::gemv(fp16)"};
+
+    for (int f = 0; f < 2; ++f){
+      half[f].compressCols(softmax.weight, (HalfMat::FORMAT)f);
+      bench.run(halfName[f], H, V, 1, 2.0*H*V, [&](){
+	  dist = softmax.bias;
+	  half[f].gemv(x, dist);
+	});
+    }
+  }
+
+  {
+    BlackOut blackout(H, V, numSample);
+    BlackOut::State state(blackout);
+    BlackOut::Grad grad;
+    VecD freq(V), delx;
+
+    //Zipfian unigram counts
+    for (int i = 0; i < V; ++i){
+      freq.coeffRef(i, 0) = (Real)(int)(1000.0/(i+1))+1.0;
+    }
+
+    rnd.uniform(blackout.weight, 0.1);
+    blackout.initSampling(freq, 0.4);
+    blackout.sampling(0, state);
+
+    bench.run("BlackOut::calcDist", H, V, 1, 2.0*H*V, [&](){
+	blackout.calcDist(x, dist);
+      });
+    bench.run("BlackOut::calcSampledDist", H, V, 1, 2.0*H*(numSample+1), [&](){
+	blackout.calcSampledDist(x, dist, state);
+      });
+    bench.run("BlackOut::backward", H, V, 1, 4.0*H*(numSample+1), [&](){
+	grad.init();
+	blackout.backward(x, dist, state, delx, grad);
+      });
+  }
+}
+
+static void benchSplit(Bench& bench, Rand& rnd){
+  std::vector<std::string> tokens;
+  std::ostringstream oss;
+
+  for (int i = 0; i < 30; ++i){
+    oss << (i ? " " : "") << "w" << rnd.next()%10000;
+  }
+
+  const std::string line = oss.str();
+
+  bench.run("Utils::split", 0, 0, (int)line.size(), 0.0, [&](){
+      Utils::split(line, tokens);
+    });
+}
+
+int main(int argc, char** argv){
+  std::string mode = "kernel";
+  std::string hiddenList = "";
+  std::string vocabList = "";
+  std::string threadList = "1,2,4";
+  std::string asyncList = "0";
+  int maxStaleness = -1;
+  int pin = 0;
+  unsigned long numaBytes = 256UL << 20;
+  std::string filter = "";
+  std::string output = "";
+  Real minTime = 0.2;
+  Real maxAllocs = -1.0;
+  unsigned long pairs = 100000;
+  int batches = 20;
+  int miniBatchSize = 32;
+  Real zipf = 1.0;
+  Real meanLength = 20.0;
+  Real sdLength = 8.0;
+  int maxLength = 50;
+  std::string optimizer = "sgd";
+  std::vector<int> hidden, vocab, threads, async;
+  Rand rnd;
+
+  for (int i = 1; i+1 < argc; i += 2){
+    const std::string opt = argv[i];
+
+    if (opt == "-mode"){
+      mode = argv[i+1];
+    }
+    else if (opt == "-hidden"){
+      hiddenList = argv[i+1];
+    }
+    else if (opt == "-vocab"){
+      vocabList = argv[i+1];
+    }
+    else if (opt == "-filter"){
+      filter = argv[i+1];
+    }
+    else if (opt == "-time"){
+      minTime = atof(argv[i+1]);
+    }
+    else if (opt == "-out"){
+      output = argv[i+1];
+    }
+    else if (opt == "-maxallocs"){
+      maxAllocs = atof(argv[i+1]);
+    }
+    else if (opt == "-threads"){
+      threadList = argv[i+1];
+    }
+    else if (opt == "-pairs"){
+      pairs = atol(argv[i+1]);
+    }
+    else if (opt == "-batches"){
+      batches = atoi(argv[i+1]);
+    }
+    else if (opt == "-batch"){
+      miniBatchSize = atoi(argv[i+1]);
+    }
+    else if (opt == "-zipf"){
+      zipf = atof(argv[i+1]);
+    }
+    else if (opt == "-len"){
+      meanLength = atof(argv[i+1]);
+    }
+    else if (opt == "-lensd"){
+      sdLength = atof(argv[i+1]);
+    }
+    else if (opt == "-maxlen"){
+      maxLength = atoi(argv[i+1]);
+    }
+    else if (opt == "-opt"){
+      optimizer = argv[i+1];
+    }
+    else if (opt == "-async"){
+      asyncList = argv[i+1];
+    }
+    else if (opt == "-staleness"){
+      maxStaleness = atoi(argv[i+1]);
+    }
+    else if (opt == "-pin"){
+      pin = atoi(argv[i+1]);
+    }
+    else if (opt == "-mbytes"){
+      numaBytes = atol(argv[i+1]) << 20;
+    }
+    else {
+      std::cerr << "Usage: " << argv[0] << " [-mode kernel|train|numa] [-hidden 64,128,...] [-vocab 1000,10000,...] [-out file.json] [-maxallocs n]" << std::endl
+		<< "  kernel: [-filter name] [-time sec]" << std::endl
+		<< "  train:  [-threads 1,2,4] [-pairs n] [-batches n] [-batch size] [-zipf s] [-len mean] [-lensd sd] [-maxlen n] [-opt sgd|adagrad|momentum|rmsprop|adam|adamw]" << std::endl
+		<< "          [-async 0,1] [-staleness n] [-pin 0|1]" << std::endl
+		<< "  numa:   [-mbytes n] [-time sec]" << std::endl;
+      return 1;
+    }
+  }
+
+  if (mode != "kernel" && mode != "train" && mode != "numa"){
+    std::cerr << "Unknown mode: " << mode << std::endl;
+    return 1;
+  }
+
+  if (hiddenList == ""){
+    hiddenList = (mode == "kernel" ? "64,128,256,512" : "256");
+  }
+  if (vocabList == ""){
+    vocabList = (mode == "kernel" ? "1000,10000,50000" : "10000");
+  }
+
+  parseList(hiddenList, hidden);
+  parseList(vocabList, vocab);
+  parseList(threadList, threads);
+  parseList(asyncList, async);
+
+  Bench bench(minTime, filter, maxAllocs);
+
+  if (mode == "kernel"){
+    for (auto h = hidden.begin(); h != hidden.end(); ++h){
+      benchRecurrent(bench, *h, rnd);
+
+      for (auto v = vocab.begin(); v != vocab.end(); ++v){
+	benchOutput(bench, *h, *v, rnd);
+      }
+    }
+
+    benchSplit(bench, rnd);
+  }
+  else if (mode == "numa"){
+    benchNuma(bench, numaBytes);
+  }
+  else {
+    int optType = -1;
+
+    for (int i = 0; i <= (int)Optimizer::ADAMW; ++i){
+      if (optimizer == optimizerName[i]){
+	optType = i;
+      }
+    }
+
+    if (optType < 0){
+      std::cerr << "Unknown optimizer: " << optimizer << std::endl;
+      return 1;
+    }
+
+    TrainBench train(pairs, batches, miniBatchSize, zipf, meanLength, sdLength, maxLength, (Optimizer::TYPE)optType, maxStaleness, pin != 0);
+
+    for (auto h = hidden.begin(); h != hidden.end(); ++h){
+      for (auto v = vocab.begin(); v != vocab.end(); ++v){
+	Real base[2] = {-1.0, -1.0}, tps, allocsPerStep;
+
+	for (auto t = threads.begin(); t != threads.end(); ++t){
+	  Real syncTps = -1.0;
+
+	  for (auto a = async.begin(); a != async.end(); ++a){
+	    const int mode = (*a != 0 ? 1 : 0);
+	    std::string res;
+	    std::ostringstream oss;
+
+	    if (!train.runChild(*h, *v, *t, mode == 1, tps, allocsPerStep, res)){
+	      std::cerr << "Failed: H=" << *h << ", V=" << *v << ", threads=" << *t << ", async=" << mode << std::endl;
+	      continue;
+	    }
+
+	    if (base[mode] < 0.0){
+	      base[mode] = tps/(*t); //the first thread count is the baseline
+	    }
+
+	    oss << "    {" << res << ", \"scaling_efficiency\": " << tps/((*t)*base[mode]);
+
+	    if (mode == 0){
+	      syncTps = tps;
+	    }
+	    else if (syncTps > 0.0){
+	      oss << ", \"speedup_vs_sync\": " << tps/syncTps;
+	    }
+
+	    oss << "}";
+	    bench.result.push_back(oss.str());
+	    bench.check("EncDec::trainOpenMP", allocsPerStep);
+	    std::cerr << "EncDec::trainOpenMP (H=" << *h << ", V=" << *v << ", threads=" << *t << (mode == 1 ? ", async" : "") << "): " << tps << " tokens/sec" << std::endl;
+	  }
+	}
+      }
+    }
+  }
+
+  if (output == ""){
+    bench.write(std::cout, mode, hiddenList, vocabList);
+  }
+  else {
+    std::ofstream ofs(output.c_str());
+
+    bench.write(ofs, mode, hiddenList, vocabList);
+  }
+
+  return (bench.failed ? 1 : 0);
+}
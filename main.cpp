@@ -1,4 +1,12 @@
 #include "EncDec.hpp"
+#include "RNNLM.hpp"
+#ifdef N3LP_ALLOC_TRACK
+#define N3LP_ALLOC_HOOKS //counts the allocations (see AllocTracker.hpp)
+#endif
+#include "AllocTracker.hpp"
+#include <sstream>
+#include <unistd.h>
+#include <sys/wait.h>
 
 int main(int argc, char** argv){
   const std::string src = "./corpus/sample.en";
@@ -7,6 +15,91 @@ int main(int argc, char** argv){
   const std::string tgtDev = "./corpus/sample.ja.dev";
 
   Eigen::initParallel();
+
+  if (argc >= 5 && std::string(argv[1]) == "-translate"){
+    //./n3lp -translate model input output [numThreads] [-numa] [-int8 | -bf16 | -fp16]: -numa pins the threads and replicates the model on each NUMA node,
+    //-int8 loads a model quantized by -quantize, and -bf16 and -fp16 keep the embeddings and the output layer in 16 bits
+    bool numa = false;
+    std::string storage = "double";
+    int threadNum = 1;
+
+    //numThreads can be omitted, so the options start at argv[5]
+    for (int i = 5; i < argc; ++i){
+      const std::string opt = argv[i];
+
+      if (opt == "-numa"){
+	numa = true;
+      }
+      else if (opt == "-int8" || opt == "-bf16" || opt == "-fp16"){
+	storage = opt.substr(1);
+      }
+      else if (i == 5 && !opt.empty() && opt.find_first_not_of("0123456789") == std::string::npos){
+	threadNum = atoi(argv[i]);
+      }
+    }
+
+    EncDec::demoTranslation(src, tgt, argv[2], argv[3], argv[4], threadNum, numa, storage);
+    return 0;
+  }
+
+  if (argc >= 4 && std::string(argv[1]) == "-quantize"){
+    //./n3lp -quantize model output: int8 post-training quantization, with the perplexity and BLEU on the development data
+    EncDec::demoQuantization(src, tgt, srcDev, tgtDev, argv[2], argv[3]);
+    return 0;
+  }
+
+  if (argc >= 2 && std::string(argv[1]) == "-lm"){
+    //./n3lp -lm [window]
+    RNNLM::demo(src, srcDev, argc >= 3 ? atoi(argv[2]) : 20);
+    return 0;
+  }
+
+  if (argc >= 3 && std::string(argv[1]) == "-dp"){
+    //./n3lp -dp numProcs [rank name]: data-parallel training by numProcs processes sharing /dev/shm/name
+    //(without rank and name, the processes are forked here, and the output of rank r > 0 goes to n3lp.rank<r>.log)
+    const int procNum = atoi(argv[2]);
+    int rank = 0;
+    std::string name;
+    std::vector<pid_t> child;
+
+    if (argc >= 5){
+      rank = atoi(argv[3]);
+      name = argv[4];
+    }
+    else {
+      std::ostringstream oss;
+
+      oss << "n3lp." << getpid();
+      name = oss.str();
+
+      for (int r = 1; r < procNum; ++r){
+	const pid_t pid = fork();
+
+	if (pid == 0){
+	  std::ostringstream log;
+
+	  log << "n3lp.rank" << r << ".log";
+	  rank = r;
+	  child.clear();
+	  if (freopen(log.str().c_str(), "w", stdout) == 0){
+	    return 1;
+	  }
+	  break;
+	}
+
+	child.push_back(pid);
+      }
+    }
+
+    EncDec::demo(src, tgt, srcDev, tgtDev, rank, procNum, name);
+
+    for (auto it = child.begin(); it != child.end(); ++it){
+      waitpid(*it, 0, 0);
+    }
+
+    return 0;
+  }
+
   EncDec::demo(src, tgt, srcDev, tgtDev);
 
   return 0;
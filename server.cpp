@@ -0,0 +1,106 @@
+#include "TranslationServer.hpp"
+#ifdef N3LP_ALLOC_TRACK
+#define N3LP_ALLOC_HOOKS //counts the allocations (see AllocTracker.hpp)
+#endif
+#include "AllocTracker.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <sys/time.h>
+
+int main(int argc, char** argv){
+  const std::string src = "./corpus/sample.en";
+  const std::string tgt = "./corpus/sample.ja";
+
+  //these settings should be the same as those in EncDec::demo
+  const int threSource = 1;
+  const int threTarget = 1;
+  const int inputDim = 200;
+  const int hiddenDim = 200;
+  const bool useBlackout = true;
+  const bool bidirectional = false;
+  const bool useAttention = false;
+  const EncDec::CELL cell = EncDec::LSTM_CELL;
+
+  std::string unixPath = "";
+  int port = 12345;
+  int numThreads = 1;
+  int beam = 20;
+  int maxLength = 100;
+  int tokenBudget = 64;
+  Real maxLatency = 0.005;
+  unsigned long encCacheSize = 64;
+  std::string storage = "double";
+
+  if (argc < 2){
+    std::cerr << "Usage: " << argv[0] << " model [-unix path | -port port] [-threads n] [-beam n] [-budget tokens] [-latency sec] [-cache MB]" << std::endl
+	      << "  [-storage double|bf16|fp16|int8] (bf16/fp16: the embeddings and the output layer in 16 bits; int8: a model by n3lp -quantize)" << std::endl;
+    return 1;
+  }
+
+  for (int i = 2; i+1 < argc; i += 2){
+    const std::string opt = argv[i];
+
+    if (opt == "-unix"){
+      unixPath = argv[i+1];
+    }
+    else if (opt == "-port"){
+      port = atoi(argv[i+1]);
+    }
+    else if (opt == "-threads"){
+      numThreads = atoi(argv[i+1]);
+    }
+    else if (opt == "-beam"){
+      beam = atoi(argv[i+1]);
+    }
+    else if (opt == "-budget"){
+      tokenBudget = atoi(argv[i+1]);
+    }
+    else if (opt == "-latency"){
+      maxLatency = atof(argv[i+1]);
+    }
+    else if (opt == "-cache"){
+      encCacheSize = atol(argv[i+1]);
+    }
+    else if (opt == "-storage"){
+      storage = argv[i+1];
+    }
+    else {
+      std::cerr << "Unknown option: " << opt << std::endl;
+      return 1;
+    }
+  }
+
+  Eigen::initParallel();
+
+  //the model is loaded only once, before accepting any request
+  Vocabulary sourceVoc(src, threSource);
+  Vocabulary targetVoc(tgt, threTarget);
+  std::vector<EncDec::Data*> trainData, devData;
+  EncDec encdec(sourceVoc, targetVoc, trainData, devData, inputDim, hiddenDim, useBlackout, bidirectional, useAttention, cell);
+  struct timeval start, end;
+
+  gettimeofday(&start, 0);
+  if (!encdec.load(argv[1], storage)){
+    return 1;
+  }
+  gettimeofday(&end, 0);
+  std::cout << "Model loaded in " << (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1.0e-06 << " sec." << std::endl;
+  std::cout << "Embeddings and output layer (" << storage << "): " << encdec.vocabBytes() << " bytes" << std::endl;
+
+  //deleted by ~EncDec, after the server (declared below) has stopped its workers
+  if (encCacheSize > 0){
+    encdec.encCache = new EncoderCache(encCacheSize*1024*1024);
+  }
+
+  TranslationServer server(encdec, numThreads, beam, maxLength, tokenBudget, maxLatency);
+  const int fd = (unixPath == "" ? server.listenTCP(port) : server.listenUnix(unixPath));
+
+  if (fd < 0){
+    return 1;
+  }
+
+  std::cout << "Listening on " << (unixPath == "" ? "127.0.0.1:"+std::to_string(port) : unixPath) << " with " << numThreads << " threads" << std::endl;
+  server.run(fd);
+
+  return 0;
+}